@@ -0,0 +1,146 @@
+#include "NaoBench.h"
+
+#include <QAtomicInteger>
+#include <QElapsedTimer>
+#include <QThreadPool>
+#include <QRunnable>
+
+#include <algorithm>
+
+namespace NaoBench {
+    namespace {
+        QAtomicInteger<quint64> sink;
+
+        class Worker : public QRunnable {
+            public:
+            Worker(int thread, qint64 ops, QAtomicInteger<qint64>* next, const Operation& op) :
+                _thread(thread), _ops(ops), _next(next), _op(op) { }
+
+            void run() override {
+                QElapsedTimer timer;
+
+                for (qint64 i = _next->fetchAndAddRelaxed(1); i < _ops; i = _next->fetchAndAddRelaxed(1)) {
+                    timer.start();
+                    bytes += _op(_thread, i);
+                    latencies.append(timer.nsecsElapsed());
+                }
+            }
+
+            QVector<qint64> latencies;
+            qint64 bytes = 0;
+
+            private:
+            int _thread;
+            qint64 _ops;
+            QAtomicInteger<qint64>* _next;
+            const Operation& _op;
+        };
+    }
+
+    double Result::mibPerSecond() const {
+        return (nanoseconds > 0) ? (bytes / 1048576.) / (nanoseconds / 1e9) : 0.;
+    }
+
+    double Result::opsPerSecond() const {
+        return (nanoseconds > 0) ? ops / (nanoseconds / 1e9) : 0.;
+    }
+
+    qint64 Result::percentile(double p) const {
+        if (latencies.isEmpty()) {
+            return 0;
+        }
+
+        int index = qBound(0, static_cast<int>(p * latencies.size()), latencies.size() - 1);
+
+        return latencies.at(index);
+    }
+
+    Result run(const QString& name, int threads, qint64 ops, const Operation& op) {
+        Result result;
+        result.name = name;
+        result.threads = threads;
+        result.ops = ops;
+
+        if (ops <= 0) {
+            return result;
+        }
+
+        // warm the caches and whatever lazy setup the operation does
+
+        op(0, 0);
+
+        QAtomicInteger<qint64> next(0);
+        QVector<Worker*> workers;
+
+        for (int t = 0; t < threads; ++t) {
+            Worker* worker = new Worker(t, ops, &next, op);
+            worker->setAutoDelete(false);
+            workers.append(worker);
+        }
+
+        QElapsedTimer timer;
+        timer.start();
+
+        if (threads == 1) {
+            workers.first()->run();
+        } else {
+            QThreadPool pool;
+            pool.setMaxThreadCount(threads);
+
+            for (Worker* worker : workers) {
+                pool.start(worker);
+            }
+
+            pool.waitForDone();
+        }
+
+        result.nanoseconds = timer.nsecsElapsed();
+
+        for (Worker* worker : workers) {
+            result.bytes += worker->bytes;
+            result.latencies.append(worker->latencies);
+
+            delete worker;
+        }
+
+        std::sort(result.latencies.begin(), result.latencies.end());
+
+        return result;
+    }
+
+    void consume(quint64 v) {
+        sink.fetchAndAddRelaxed(v);
+    }
+
+    void printHeader(QTextStream& out) {
+        out << QString("%1 %2 %3 %4 %5 %6 %7 %8 %9")
+               .arg("benchmark", -32)
+               .arg("thr", 4)
+               .arg("ops", 9)
+               .arg("MiB/s", 10)
+               .arg("ops/s", 11)
+               .arg("p50 us", 10)
+               .arg("p90 us", 10)
+               .arg("p99 us", 10)
+               .arg("max us", 10) << endl;
+    }
+
+    void print(QTextStream& out, const Result& result) {
+        auto micro = [](qint64 ns) {
+            return QString::number(ns / 1000., 'f', 1);
+        };
+
+        // no throughput for things that don't move data around (opening, lookups)
+
+        out << QString("%1 %2 %3 %4 %5 %6 %7 %8 %9")
+               .arg(result.name, -32)
+               .arg(result.threads, 4)
+               .arg(result.ops, 9)
+               .arg((result.bytes > 0) ? QString::number(result.mibPerSecond(), 'f', 1) : QString("-"), 10)
+               .arg(QString::number(result.opsPerSecond(), 'f', 1), 11)
+               .arg(micro(result.percentile(0.50)), 10)
+               .arg(micro(result.percentile(0.90)), 10)
+               .arg(micro(result.percentile(0.99)), 10)
+               .arg(micro(result.latencies.isEmpty() ? 0 : result.latencies.last()), 10) << endl;
+    }
+}
@@ -0,0 +1,58 @@
+#ifndef NAOBENCH_H
+#define NAOBENCH_H
+
+#include <QIODevice>
+#include <QString>
+#include <QVector>
+#include <QTextStream>
+
+#include <functional>
+
+// Tiny benchmark harness: time every operation, spread them over a number of threads,
+// and report throughput and latency percentiles.
+
+namespace NaoBench {
+    struct Result {
+        QString name;
+        int threads = 1;
+        qint64 ops = 0;
+        qint64 bytes = 0;
+        qint64 nanoseconds = 0;         // wall clock for all operations together
+        QVector<qint64> latencies;      // nanoseconds per operation, sorted
+
+        double mibPerSecond() const;
+        double opsPerSecond() const;
+        qint64 percentile(double p) const;
+    };
+
+    // runs operation i on the given thread, returns how many bytes it processed
+    typedef std::function<qint64(int thread, qint64 i)> Operation;
+
+    // ops operations pulled from a shared counter by the given amount of threads, after one untimed warm-up
+    Result run(const QString& name, int threads, qint64 ops, const Operation& op);
+
+    // results that are thrown away anyway, so the compiler can't throw the work away as well
+    void consume(quint64 v);
+
+    void printHeader(QTextStream& out);
+    void print(QTextStream& out, const Result& result);
+
+    // sink for the extraction benchmarks
+    class NullDevice : public QIODevice {
+        public:
+        NullDevice() {
+            open(QIODevice::WriteOnly);
+        }
+
+        protected:
+        qint64 readData(char*, qint64) override {
+            return -1;
+        }
+
+        qint64 writeData(const char*, qint64 len) override {
+            return len;
+        }
+    };
+}
+
+#endif // NAOBENCH_H
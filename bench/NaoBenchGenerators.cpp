@@ -0,0 +1,805 @@
+#include "NaoBenchGenerators.h"
+
+#include <QFile>
+
+namespace NaoBench {
+    namespace {
+        template <typename T, NaoEndian E>
+        void append(QByteArray& out, T v) {
+            char b[sizeof(T)];
+            NaoBytes::store<T, E>(v, b);
+            out.append(b, sizeof(T));
+        }
+
+        qint64 alignUp(qint64 v, qint64 alignment) {
+            return (v + alignment - 1) / alignment * alignment;
+        }
+
+        bool writeZeros(QIODevice& out, qint64 n) {
+            static const QByteArray zeros(0x10000, '\0');
+
+            while (n > 0) {
+                qint64 count = qMin<qint64>(n, zeros.size());
+
+                if (out.write(zeros.constData(), count) != count) {
+                    return false;
+                }
+
+                n -= count;
+            }
+
+            return true;
+        }
+
+        bool padTo(QIODevice& out, qint64 pos) {
+            return writeZeros(out, pos - out.pos());
+        }
+
+        // streams noise in pieces, so stored entries can be as big as we like
+        bool writeNoise(QIODevice& out, Random& rand, qint64 n) {
+            QByteArray buf(static_cast<int>(qMin<qint64>(n, 0x100000)), '\0');
+
+            while (n > 0) {
+                qint64 count = qMin<qint64>(n, buf.size());
+                rand.fill(buf.data(), count);
+
+                if (out.write(buf.constData(), count) != count) {
+                    return false;
+                }
+
+                n -= count;
+            }
+
+            return true;
+        }
+
+        // CPK, TOC and ETOC blocks: fourCC, 0xFF, the packet size and then the packet itself
+        QByteArray cpkBlock(const char* fourCC, const QByteArray& utf) {
+            QByteArray out(fourCC, 4);
+            append<quint32, NaoEndian::Little>(out, 0xFF);
+            append<quint64, NaoEndian::Little>(out, utf.size());
+            out.append(utf);
+
+            return out;
+        }
+
+        struct CPKHeader {
+            quint64 contentOffset = 0;
+            quint64 contentSize = 0;
+            quint64 tocOffset = 0;
+            quint64 tocSize = 0;
+            quint64 etocOffset = 0;
+            quint64 etocSize = 0;
+            quint32 files = 0;
+            quint16 align = 0;
+            bool etoc = false;
+        };
+
+        // only fixed size values, so the placeholder and the final header are the same size
+        QByteArray cpkHeader(const CPKHeader& h) {
+            typedef UTFWriter::UTF UTF;
+
+            UTFWriter utf("CpkHeader");
+            utf.addColumn("UpdateDateTime", UTF::uLong);
+            utf.addColumn("ContentOffset", UTF::uLong);
+            utf.addColumn("ContentSize", UTF::uLong);
+            utf.addColumn("TocOffset", UTF::uLong);
+            utf.addColumn("TocSize", UTF::uLong);
+
+            if (h.etoc) {
+                utf.addColumn("EtocOffset", UTF::uLong);
+                utf.addColumn("EtocSize", UTF::uLong);
+            }
+
+            utf.addColumn("Files", UTF::uInt);
+            utf.addColumn("Groups", UTF::uInt);
+            utf.addColumn("Align", UTF::uShort);
+            utf.addColumn("Version", UTF::uShort);
+            utf.addColumn("Revision", UTF::uShort);
+            utf.addColumn("CpkMode", UTF::uInt);
+            utf.addColumn("Tvers", UTF::String);
+
+            utf.put(1);
+            utf.put(h.contentOffset);
+            utf.put(h.contentSize);
+            utf.put(h.tocOffset);
+            utf.put(h.tocSize);
+
+            if (h.etoc) {
+                utf.put(h.etocOffset);
+                utf.put(h.etocSize);
+            }
+
+            utf.put(h.files);
+            utf.put(0);
+            utf.put(h.align);
+            utf.put(7);
+            utf.put(2);
+            utf.put(1);
+            utf.put(QByteArray("libnao bench"));
+            utf.endRow();
+
+            return cpkBlock("CPK ", utf.finish());
+        }
+
+        // a USM chunk: 0x20 byte header, the payload and padding up to a multiple of 0x20
+        bool writeChunk(QIODevice& out, quint32 id, quint32 dataType, const char* payload, qint64 size) {
+            quint16 footerSize = static_cast<quint16>((0x20 - (size % 0x20)) % 0x20);
+
+            QByteArray header;
+            append<quint32, NaoEndian::Big>(header, id);
+            append<quint32, NaoEndian::Big>(header, static_cast<quint32>(0x18 + size + footerSize));
+            append<quint16, NaoEndian::Big>(header, 0x18);
+            append<quint16, NaoEndian::Big>(header, footerSize);
+            append<quint32, NaoEndian::Big>(header, dataType);
+            header.append(QByteArray(16, '\0'));
+
+            return out.write(header) == header.size()
+                    && out.write(payload, size) == size
+                    && writeZeros(out, footerSize);
+        }
+
+        QByteArray number(quint64 n, int width) {
+            return QByteArray::number(n).rightJustified(width, '0');
+        }
+    }
+
+    quint64 Random::next() {
+        quint64 z = (_state += 0x9E3779B97F4A7C15ULL);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+
+        return z ^ (z >> 31);
+    }
+
+    quint64 Random::bounded(quint64 max) {
+        return (max == 0) ? 0 : (next() % max);
+    }
+
+    quint64 Random::sizeBetween(quint64 min, quint64 max) {
+        if (min >= max) {
+            return min;
+        }
+
+        // pick a power of 2 first, otherwise nearly everything would end up close to max
+
+        int low = 0;
+        int high = 0;
+
+        while ((2ULL << low) <= min) {
+            ++low;
+        }
+
+        while ((2ULL << high) <= max) {
+            ++high;
+        }
+
+        int bucket = low + static_cast<int>(bounded(high - low + 1));
+        quint64 from = qMax(min, 1ULL << bucket);
+        quint64 to = qMin(max, (2ULL << bucket) - 1);
+
+        return from + bounded(to - from + 1);
+    }
+
+    void Random::fill(char* dst, qint64 n) {
+        while (n >= 8) {
+            quint64 v = next();
+            memcpy(dst, &v, 8);
+
+            dst += 8;
+            n -= 8;
+        }
+
+        if (n > 0) {
+            quint64 v = next();
+            memcpy(dst, &v, n);
+        }
+    }
+
+    QByteArray entryData(quint64 seed, quint32 index, qint64 size, bool compressible) {
+        QByteArray out(static_cast<int>(size), '\0');
+        Random rand(seed * 0x100000001B3ULL + index);
+
+        if (!compressible) {
+            rand.fill(out.data(), size);
+
+            return out;
+        }
+
+        // words from a small vocabulary, skewed towards the first ones, with the odd bit of noise in between
+        // this compresses about as well as the scripts and tables in real archives
+
+        Random words(seed);
+        QVector<QByteArray> vocabulary(256);
+
+        for (QByteArray& word : vocabulary) {
+            word.resize(2 + static_cast<int>(words.bounded(9)));
+
+            for (int i = 0; i < word.size(); ++i) {
+                word[i] = static_cast<char>('a' + words.bounded(26));
+            }
+        }
+
+        char* dst = out.data();
+        qint64 pos = 0;
+
+        while (pos < size) {
+            if (rand.bounded(32) == 0) {
+                qint64 n = qMin<qint64>(size - pos, 1 + rand.bounded(8));
+                rand.fill(dst + pos, n);
+                pos += n;
+
+                continue;
+            }
+
+            const QByteArray& word = vocabulary.at(static_cast<int>(qMin(rand.bounded(256), rand.bounded(256))));
+            qint64 n = qMin<qint64>(size - pos, word.size());
+
+            memcpy(dst + pos, word.constData(), n);
+            pos += n;
+
+            if (pos < size) {
+                dst[pos++] = ' ';
+            }
+        }
+
+        return out;
+    }
+
+    UTFWriter::UTFWriter(const QByteArray& tableName, uchar encodeType) :
+        _encodeType(encodeType) {
+
+        // CRI's tools always start the string table with this
+
+        _string("<NULL>");
+        _tableName = _string(tableName);
+    }
+
+    void UTFWriter::addColumn(const QByteArray& name, quint32 type) {
+        _types.append(type);
+        _names.append(_string(name));
+    }
+
+    void UTFWriter::put(quint64 val) {
+        switch (_types.at(_column)) {
+            case UTF::uChar:
+            case UTF::sChar:
+                append<quint8, NaoEndian::Big>(_rows, static_cast<quint8>(val));
+                break;
+
+            case UTF::uShort:
+            case UTF::sShort:
+                append<quint16, NaoEndian::Big>(_rows, static_cast<quint16>(val));
+                break;
+
+            case UTF::uInt:
+            case UTF::sInt:
+                append<quint32, NaoEndian::Big>(_rows, static_cast<quint32>(val));
+                break;
+
+            case UTF::uLong:
+            case UTF::sLong:
+                append<quint64, NaoEndian::Big>(_rows, val);
+                break;
+
+            default:
+                qFatal("UTFWriter: column %d does not hold integers", _column);
+        }
+
+        ++_column;
+    }
+
+    void UTFWriter::put(const QByteArray& val) {
+        switch (_types.at(_column)) {
+            case UTF::String:
+                append<quint32, NaoEndian::Big>(_rows, _string(val));
+                break;
+
+            case UTF::Data:
+                append<quint32, NaoEndian::Big>(_rows, _data.size());
+                append<quint32, NaoEndian::Big>(_rows, val.size());
+                _data.append(val);
+                break;
+
+            default:
+                qFatal("UTFWriter: column %d does not hold strings or data", _column);
+        }
+
+        ++_column;
+    }
+
+    void UTFWriter::endRow() {
+        if (_column != _types.size()) {
+            qFatal("UTFWriter: row %u is missing values", _rowCount);
+        }
+
+        _column = 0;
+        ++_rowCount;
+    }
+
+    quint32 UTFWriter::rowCount() const {
+        return _rowCount;
+    }
+
+    QByteArray UTFWriter::finish() const {
+        static const quint16 widths[] = { 1, 1, 2, 2, 4, 4, 8, 8, 4, 8, 4, 8 };
+
+        quint16 rowSize = 0;
+
+        for (quint32 type : _types) {
+            rowSize += widths[type];
+        }
+
+        // offsets in the header are relative to the end of the size field
+
+        quint32 rowsOffset = 0x18 + 5 * _types.size();
+        quint32 stringsOffset = rowsOffset + _rows.size();
+        quint32 dataOffset = static_cast<quint32>(alignUp(stringsOffset + _strings.size(), 8));
+        quint32 tableSize = static_cast<quint32>(alignUp(dataOffset + _data.size(), 8));
+
+        QByteArray out("@UTF", 4);
+        out.reserve(tableSize + 8);
+
+        append<quint32, NaoEndian::Big>(out, tableSize);
+        append<quint8, NaoEndian::Big>(out, 0);
+        append<quint8, NaoEndian::Big>(out, _encodeType);
+        append<quint16, NaoEndian::Big>(out, static_cast<quint16>(rowsOffset));
+        append<quint32, NaoEndian::Big>(out, stringsOffset);
+        append<quint32, NaoEndian::Big>(out, dataOffset);
+        append<quint32, NaoEndian::Big>(out, _tableName);
+        append<quint16, NaoEndian::Big>(out, static_cast<quint16>(_types.size()));
+        append<quint16, NaoEndian::Big>(out, rowSize);
+        append<quint32, NaoEndian::Big>(out, _rowCount);
+
+        for (int i = 0; i < _types.size(); ++i) {
+            append<quint8, NaoEndian::Big>(out, static_cast<quint8>(UTF::HasName | UTF::RowVal | _types.at(i)));
+            append<quint32, NaoEndian::Big>(out, _names.at(i));
+        }
+
+        out.append(_rows);
+        out.append(_strings);
+        out.append(QByteArray(dataOffset + 8 - out.size(), '\0'));
+        out.append(_data);
+        out.append(QByteArray(tableSize + 8 - out.size(), '\0'));
+
+        return out;
+    }
+
+    quint32 UTFWriter::_string(const QByteArray& str) {
+        QHash<QByteArray, quint32>::const_iterator it = _stringOffsets.constFind(str);
+
+        if (it != _stringOffsets.constEnd()) {
+            return it.value();
+        }
+
+        quint32 offset = _strings.size();
+        _strings.append(str);
+        _strings.append('\0');
+        _stringOffsets.insert(str, offset);
+
+        return offset;
+    }
+
+    bool writeCPK(const QString& path, const ArchiveSpec& spec, CPKLayout* layout) {
+        typedef UTFWriter::UTF UTF;
+
+        QFile out(path);
+
+        if (!out.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+            return false;
+        }
+
+        // content goes first and the tables after it, so everything is written in a single pass
+        // the header only has fixed size values, so it gets a placeholder now and the real values at the end
+
+        CPKHeader header;
+        header.contentOffset = 0x800;
+        header.files = spec.entries;
+        header.align = static_cast<quint16>(spec.align);
+        header.etoc = spec.etoc;
+
+        if (out.write(cpkHeader(header)) < 0 || !padTo(out, header.contentOffset)) {
+            return false;
+        }
+
+        UTFWriter toc("CpkTocInfo");
+        toc.addColumn("DirName", UTF::String);
+        toc.addColumn("FileName", UTF::String);
+        toc.addColumn("FileSize", UTF::uInt);
+        toc.addColumn("ExtractSize", UTF::uInt);
+        toc.addColumn("FileOffset", UTF::uLong);
+        toc.addColumn("ID", UTF::uInt);
+        toc.addColumn("UserString", UTF::String);
+
+        UTFWriter etoc("CpkEtocInfo");
+        etoc.addColumn("UpdateDateTime", UTF::uLong);
+        etoc.addColumn("LocalDir", UTF::String);
+
+        Random rand(spec.seed);
+        quint32 compressed = 0;
+
+        for (quint32 i = 0; i < spec.entries; ++i) {
+            qint64 size = rand.sizeBetween(spec.minSize, spec.maxSize);
+            bool compress = size >= 0x200 && static_cast<quint64>(size) <= spec.compressLimit
+                    && rand.bounded(100) < spec.compressedPercent;
+
+            qint64 offset = alignUp(out.pos(), spec.align);
+
+            if (!padTo(out, offset)) {
+                return false;
+            }
+
+            qint64 stored = size;
+
+            if (compress) {
+                QByteArray data = entryData(spec.seed, i, size, true);
+                QByteArray packed = NaoCRILAYLA::compress(data);
+
+                // like the real tools, keep whatever is smaller
+
+                if (packed.size() < size) {
+                    stored = packed.size();
+                    ++compressed;
+
+                    if (out.write(packed) != stored) {
+                        return false;
+                    }
+                } else if (out.write(data) != size) {
+                    return false;
+                }
+            } else {
+                Random noise(spec.seed ^ (static_cast<quint64>(i) << 32));
+
+                if (!writeNoise(out, noise, size)) {
+                    return false;
+                }
+            }
+
+            QByteArray dir = "data/dir" + number(i / 256, 4);
+
+            toc.put(dir);
+            toc.put("file" + number(i, 7) + ".bin");
+            toc.put(stored);
+            toc.put(size);
+            toc.put(offset - header.contentOffset);   // relative to the TOC (clamped to 0x800)
+            toc.put(i);
+            toc.put(QByteArray("<NULL>"));
+            toc.endRow();
+
+            etoc.put(0x07E20B0100000000ULL + i);
+            etoc.put(dir);
+            etoc.endRow();
+        }
+
+        header.contentSize = out.pos() - header.contentOffset;
+
+        QByteArray tocUTF = toc.finish();
+        header.tocOffset = alignUp(out.pos(), 0x800);
+        header.tocSize = tocUTF.size() + 0x10;
+
+        if (!padTo(out, header.tocOffset) || out.write(cpkBlock("TOC ", tocUTF)) < 0) {
+            return false;
+        }
+
+        QByteArray etocUTF;
+
+        if (spec.etoc) {
+            etocUTF = etoc.finish();
+            header.etocOffset = alignUp(out.pos(), 0x800);
+            header.etocSize = etocUTF.size() + 0x10;
+
+            if (!padTo(out, header.etocOffset) || out.write(cpkBlock("ETOC", etocUTF)) < 0) {
+                return false;
+            }
+        }
+
+        if (!out.seek(0) || out.write(cpkHeader(header)) < 0) {
+            return false;
+        }
+
+        if (layout) {
+            layout->tocOffset = header.tocOffset + 0x10;
+            layout->tocSize = tocUTF.size();
+            layout->etocOffset = spec.etoc ? (header.etocOffset + 0x10) : 0;
+            layout->etocSize = etocUTF.size();
+            layout->contentSize = header.contentSize;
+            layout->compressed = compressed;
+        }
+
+        return true;
+    }
+
+    bool writeDAT(const QString& path, const ArchiveSpec& spec) {
+        const quint32 n = spec.entries;
+
+        // sizes come first, the offset table has to be written before the data
+
+        Random rand(spec.seed);
+        QVector<quint32> sizes(n);
+
+        for (quint32 i = 0; i < n; ++i) {
+            sizes[i] = static_cast<quint32>(qMin<quint64>(rand.sizeBetween(spec.minSize, spec.maxSize), 0xFFFFFFFFU));
+        }
+
+        const quint32 nameAlignment = 17;   // "entry0000000.bin" plus null
+
+        quint32 filesOffset = 0x20;
+        quint32 extensionsOffset = filesOffset + 4 * n;
+        quint32 namesOffset = extensionsOffset + 4 * n;
+        quint32 sizesOffset = static_cast<quint32>(alignUp(namesOffset + 4 + qint64(n) * nameAlignment, 4));
+        qint64 dataOffset = alignUp(sizesOffset + qint64(4) * n, 0x10);
+
+        QVector<quint32> offsets(n);
+        qint64 offset = dataOffset;
+
+        for (quint32 i = 0; i < n; ++i) {
+            offset = alignUp(offset, spec.align);
+
+            if (offset + sizes[i] > 0xFFFFFFFFLL) {
+                return false;
+            }
+
+            offsets[i] = static_cast<quint32>(offset);
+            offset += sizes[i];
+        }
+
+        QFile out(path);
+
+        if (!out.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+            return false;
+        }
+
+        QByteArray tables("DAT\0", 4);
+        append<quint32, NaoEndian::Little>(tables, n);
+        append<quint32, NaoEndian::Little>(tables, filesOffset);
+        append<quint32, NaoEndian::Little>(tables, extensionsOffset);
+        append<quint32, NaoEndian::Little>(tables, namesOffset);
+        append<quint32, NaoEndian::Little>(tables, sizesOffset);
+        append<quint32, NaoEndian::Little>(tables, 0);  // no hash map
+        append<quint32, NaoEndian::Little>(tables, 0);
+
+        for (quint32 o : offsets) {
+            append<quint32, NaoEndian::Little>(tables, o);
+        }
+
+        for (quint32 i = 0; i < n; ++i) {
+            tables.append("bin\0", 4);
+        }
+
+        append<quint32, NaoEndian::Little>(tables, nameAlignment);
+
+        for (quint32 i = 0; i < n; ++i) {
+            tables.append(("entry" + number(i, 7) + ".bin").leftJustified(nameAlignment, '\0'));
+        }
+
+        tables.append(QByteArray(sizesOffset - tables.size(), '\0'));
+
+        for (quint32 s : sizes) {
+            append<quint32, NaoEndian::Little>(tables, s);
+        }
+
+        if (out.write(tables) != tables.size()) {
+            return false;
+        }
+
+        for (quint32 i = 0; i < n; ++i) {
+            Random noise(spec.seed ^ (static_cast<quint64>(i) << 32));
+
+            if (!padTo(out, offsets[i]) || !writeNoise(out, noise, sizes[i])) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    bool writeUSM(const QString& path, const USMSpec& spec) {
+        typedef UTFWriter::UTF UTF;
+
+        const quint32 video = 0x40534656;   // @SFV
+        const quint32 audio = 0x40534641;   // @SFA
+
+        QVector<quint32> streams({ video });
+
+        if (spec.audio) {
+            streams.append(audio);
+        }
+
+        // chunk sizes are decided up front, the stream sizes go in the CRID table
+
+        Random rand(spec.seed);
+        QVector<QVector<quint32>> sizes(streams.size());
+        QVector<quint64> totals(streams.size(), 0);
+
+        for (int s = 0; s < streams.size(); ++s) {
+            for (quint32 c = 0; c < spec.chunks; ++c) {
+                quint32 size = static_cast<quint32>(alignUp(spec.chunkSize / 2 + rand.bounded(spec.chunkSize), 4));
+
+                // a 0x20 byte payload is how the reader recognises the end of a stream
+
+                if (size == 0x20) {
+                    size += 4;
+                }
+
+                sizes[s].append(size);
+                totals[s] += size;
+            }
+        }
+
+        QFile out(path);
+
+        if (!out.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+            return false;
+        }
+
+        UTFWriter dir("CRIUSF_DIR_STREAM", 1);
+        dir.addColumn("fmtver", UTF::uInt);
+        dir.addColumn("filename", UTF::String);
+        dir.addColumn("filesize", UTF::uInt);
+        dir.addColumn("datasize", UTF::uInt);
+        dir.addColumn("stmid", UTF::uInt);
+        dir.addColumn("chno", UTF::uShort);
+        dir.addColumn("minchk", UTF::uShort);
+        dir.addColumn("minbuf", UTF::uInt);
+        dir.addColumn("avbps", UTF::uInt);
+
+        // first row describes the whole file, then one per stream
+
+        dir.put(0x01000000);
+        dir.put(QByteArray("bench.usm"));
+        dir.put(0);
+        dir.put(0);
+        dir.put(0);
+        dir.put(0xFFFF);
+        dir.put(1);
+        dir.put(0);
+        dir.put(0);
+        dir.endRow();
+
+        for (int s = 0; s < streams.size(); ++s) {
+            dir.put(0x01000000);
+            dir.put(QByteArray(streams.at(s) == video ? "bench.m2v" : "bench.adx"));
+            dir.put(totals.at(s));
+            dir.put(0);
+            dir.put(streams.at(s));
+            dir.put(0);
+            dir.put(3);
+            dir.put(spec.chunkSize * 2);
+            dir.put(spec.chunkSize * 8 * 30);
+            dir.endRow();
+        }
+
+        QByteArray dirUTF = dir.finish();
+
+        if (!writeChunk(out, 0x43524944, 1, dirUTF.constData(), dirUTF.size())) {    // CRID, block type 1
+            return false;
+        }
+
+        for (quint32 id : streams) {
+            UTFWriter info((id == video) ? "VIDEO_HDRINFO" : "AUDIO_HDRINFO", 1);
+
+            if (id == video) {
+                info.addColumn("width", UTF::uInt);
+                info.addColumn("height", UTF::uInt);
+                info.addColumn("total_frames", UTF::uInt);
+                info.addColumn("framerate_n", UTF::uInt);
+                info.addColumn("framerate_d", UTF::uInt);
+
+                info.put(1920);
+                info.put(1080);
+                info.put(spec.chunks);
+                info.put(30000);
+                info.put(1001);
+            } else {
+                info.addColumn("sampling_rate", UTF::uInt);
+                info.addColumn("total_samples", UTF::uInt);
+                info.addColumn("num_channels", UTF::uChar);
+
+                info.put(48000);
+                info.put(spec.chunks * 1600ULL);
+                info.put(2);
+            }
+
+            info.endRow();
+
+            QByteArray infoUTF = info.finish();
+
+            if (!writeChunk(out, id, 1, infoUTF.constData(), infoUTF.size())) {
+                return false;
+            }
+        }
+
+        // interleave the streams like a muxer would
+
+        QByteArray payload;
+
+        for (quint32 c = 0; c < spec.chunks; ++c) {
+            for (int s = 0; s < streams.size(); ++s) {
+                payload.resize(sizes[s][c]);
+                rand.fill(payload.data(), payload.size());
+
+                if (!writeChunk(out, streams.at(s), 0, payload.constData(), payload.size())) {
+                    return false;
+                }
+            }
+        }
+
+        for (quint32 id : streams) {
+            if (!writeChunk(out, id, 2, "#CONTENTS END   ===============\0", 0x20)) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    QByteArray makeJapaneseTOC(quint32 entries, quint64 seed) {
+        typedef UTFWriter::UTF UTF;
+
+        // キャラクター, 背景, 効果音, ステージ, 会話, 音声, イベント and ﾀｲﾄﾙ (half width) in Shift-JIS
+
+        static const char* const words[] = {
+            "\x83\x4C\x83\x83\x83\x89\x83\x4E\x83\x5E\x81\x5B",
+            "\x94\x77\x8C\x69",
+            "\x8C\xF8\x89\xCA\x89\xB9",
+            "\x83\x58\x83\x65\x81\x5B\x83\x57",
+            "\x89\xEF\x98\x62",
+            "\x89\xB9\x90\xBA",
+            "\x83\x43\x83\x78\x83\x93\x83\x67",
+            "\xC0\xB2\xC4\xD9"
+        };
+
+        const quint64 wordCount = sizeof(words) / sizeof(words[0]);
+
+        Random rand(seed);
+
+        UTFWriter toc("CpkTocInfo");
+        toc.addColumn("DirName", UTF::String);
+        toc.addColumn("FileName", UTF::String);
+        toc.addColumn("FileSize", UTF::uInt);
+        toc.addColumn("ID", UTF::uInt);
+        toc.addColumn("UserString", UTF::String);
+
+        for (quint32 i = 0; i < entries; ++i) {
+            bool ascii = rand.bounded(3) == 0;
+
+            QByteArray dir = ascii ? "data/dir" + number(i / 256, 4) : QByteArray("data/") + words[(i / 256) % wordCount];
+            QByteArray name = ascii ? "file" + number(i, 7) : words[rand.bounded(wordCount)] + ("_" + number(i, 5));
+
+            toc.put(dir);
+            toc.put(name + ".bin");
+            toc.put(rand.sizeBetween(0x100, 0x100000));
+            toc.put(i);
+            toc.put(QByteArray("<NULL>"));
+            toc.endRow();
+        }
+
+        return toc.finish();
+    }
+
+    QByteArray makeVDF(quint32 folders, quint32 apps, quint64 seed) {
+        Random rand(seed);
+
+        QByteArray out("\"libraryfolders\"\n{\n");
+
+        for (quint32 i = 0; i < folders; ++i) {
+            out += "\t\"" + QByteArray::number(i) + "\"\n\t{\n";
+            out += "\t\t\"path\"\t\t\"/mnt/library" + QByteArray::number(i) + "/SteamLibrary\"\n";
+            out += "\t\t\"label\"\t\t\"\"\n";
+            out += "\t\t\"contentid\"\t\t\"" + QByteArray::number(rand.next() >> 1) + "\"\n";
+            out += "\t\t\"totalsize\"\t\t\"" + QByteArray::number(rand.bounded(1ULL << 42)) + "\"\n";
+            out += "\t\t\"apps\"\n\t\t{\n";
+
+            for (quint32 j = 0; j < apps; ++j) {
+                out += "\t\t\t\"" + QByteArray::number(10 + rand.bounded(2000000)) + "\"\t\t\""
+                        + QByteArray::number(rand.bounded(1ULL << 36)) + "\"\n";
+            }
+
+            out += "\t\t}\n\t}\n";
+        }
+
+        out += "}\n";
+
+        return out;
+    }
+}
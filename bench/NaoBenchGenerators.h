@@ -0,0 +1,106 @@
+#ifndef NAOBENCHGENERATORS_H
+#define NAOBENCHGENERATORS_H
+
+#include "NaoCRIWareReader.h"
+#include "NaoCRILAYLA.h"
+
+#include <QByteArray>
+#include <QString>
+#include <QHash>
+
+// Deterministic synthetic inputs for the benchmarks.
+// The same spec (and seed) always produces the same bytes, on every platform and Qt version.
+
+namespace NaoBench {
+
+    // splitmix64, we don't want the data to change with the Qt version
+    class Random {
+        public:
+        explicit Random(quint64 seed) : _state(seed) { }
+
+        quint64 next();
+        quint64 bounded(quint64 max);                   // [0, max)
+        quint64 sizeBetween(quint64 min, quint64 max);  // uniform over the powers of 2 in [min, max], then within one
+        void fill(char* dst, qint64 n);
+
+        private:
+        quint64 _state;
+    };
+
+    struct ArchiveSpec {
+        quint32 entries = 10000;
+        quint64 minSize = 0x100;
+        quint64 maxSize = 0x100000;
+        quint32 compressedPercent = 40;     // CPK only, share of entries stored as CRILAYLA
+        quint64 compressLimit = 0x400000;   // anything bigger is always stored
+        quint32 align = 0x20;
+        bool etoc = true;
+        quint64 seed = 1;
+    };
+
+    // where writeCPK put things, so the benchmarks don't need to go looking
+    struct CPKLayout {
+        qint64 tocOffset = 0;       // offset of the TOC @UTF packet (after the "TOC " block header)
+        qint64 tocSize = 0;
+        qint64 etocOffset = 0;
+        qint64 etocSize = 0;
+        qint64 contentSize = 0;
+        quint32 compressed = 0;     // entries stored as CRILAYLA
+    };
+
+    struct USMSpec {
+        quint32 chunks = 1000;      // data chunks per stream
+        quint32 chunkSize = 0x4000; // average payload size
+        bool audio = true;          // add an audio stream next to the video stream
+        quint64 seed = 1;
+    };
+
+    // contents of an entry: compressible "text" or plain noise
+    QByteArray entryData(quint64 seed, quint32 index, qint64 size, bool compressible);
+
+    // builds an @UTF table, every column is stored per row
+    class UTFWriter {
+        public:
+        typedef NaoCRIWareReader::UTFReader UTF;
+
+        UTFWriter(const QByteArray& tableName, uchar encodeType = 0);
+
+        void addColumn(const QByteArray& name, quint32 type);
+
+        // values are written in column order, put() has to match the type of the column
+        void put(quint64 val);
+        void put(const QByteArray& val);    // String and Data columns
+        void endRow();
+
+        quint32 rowCount() const;
+        QByteArray finish() const;
+
+        private:
+        quint32 _string(const QByteArray& str);
+
+        uchar _encodeType;
+        quint32 _tableName;
+
+        QVector<quint32> _types;
+        QVector<quint32> _names;
+        int _column = 0;
+        quint32 _rowCount = 0;
+
+        QByteArray _rows;
+        QByteArray _strings;
+        QByteArray _data;
+        QHash<QByteArray, quint32> _stringOffsets;
+    };
+
+    bool writeCPK(const QString& path, const ArchiveSpec& spec, CPKLayout* layout = nullptr);
+    bool writeDAT(const QString& path, const ArchiveSpec& spec);   // offsets are 32 bits, so this fails past 4 GiB
+    bool writeUSM(const QString& path, const USMSpec& spec);
+
+    // a TOC @UTF packet like a Japanese game's: Shift-JIS directory and file names, about a third of them plain ASCII
+    QByteArray makeJapaneseTOC(quint32 entries, quint64 seed);
+
+    // Steam libraryfolders.vdf with the given amount of libraries and apps per library
+    QByteArray makeVDF(quint32 folders, quint32 apps, quint64 seed);
+}
+
+#endif // NAOBENCHGENERATORS_H
@@ -0,0 +1,31 @@
+#-------------------------------------------------
+#
+# libnao benchmarks, built through ../libnao.pro
+#
+#-------------------------------------------------
+
+QT       -= gui
+
+CONFIG += c++1z console
+CONFIG -= app_bundle
+
+TARGET = naobench
+TEMPLATE = app
+
+DEFINES += QT_DEPRECATED_WARNINGS
+
+INCLUDEPATH += $$PWD/../libnao
+DEPENDPATH += $$PWD/../libnao
+
+win32:CONFIG(release, debug|release): LIBS += -L$$OUT_PWD/../libnao/release/ -llibnao
+else:win32:CONFIG(debug, debug|release): LIBS += -L$$OUT_PWD/../libnao/debug/ -llibnao
+else:unix: LIBS += -L$$OUT_PWD/../libnao/ -llibnao
+
+SOURCES += \
+        main.cpp \
+    NaoBench.cpp \
+    NaoBenchGenerators.cpp
+
+HEADERS += \
+    NaoBench.h \
+    NaoBenchGenerators.h
@@ -0,0 +1,1005 @@
+#include "NaoBench.h"
+#include "NaoBenchGenerators.h"
+
+#include "NaoFileReader.h"
+#include "NaoCRIWareReader.h"
+#include "NaoCRILAYLA.h"
+#include "NaoDATReader.h"
+#include "NaoIndexCache.h"
+#include "NaoText.h"
+#include "NaoUTFSchema.h"
+
+#include "vdf_parser.hpp"
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QTemporaryDir>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QThread>
+#include <QDir>
+#include <QTextCodec>
+
+#include <string>
+
+using namespace NaoBench;
+
+namespace {
+    struct Context {
+        QString cpk;
+        QString dat;
+        QString usm;
+        CPKLayout layout;
+        ArchiveSpec spec;
+        NaoFileReader::IOPolicy policy;
+
+        QVector<int> threads;
+        qint64 ops;
+        QStringList groups;
+
+        QTextStream* out;
+
+        bool wants(const QString& group) const {
+            return groups.isEmpty() || groups.contains(group);
+        }
+
+        void report(const Result& result) const {
+            print(*out, result);
+            out->flush();
+        }
+    };
+
+    // the TOC columns the archive reader reads, for the schema decoder
+    struct TocRow {
+        QString fileName;
+        QString dirName;
+        quint64 fileOffset;
+        quint32 fileSize;
+        quint32 extractSize;
+        quint32 id;
+    };
+
+    constexpr auto tocSchema = NaoUTF::schema<TocRow>(
+        NaoUTF::field<NaoUTF::UTF::String>("FileName", &TocRow::fileName),
+        NaoUTF::field<NaoUTF::UTF::String>("DirName", &TocRow::dirName),
+        NaoUTF::field<NaoUTF::UTF::uLong>("FileOffset", &TocRow::fileOffset),
+        NaoUTF::field<NaoUTF::UTF::uInt>("FileSize", &TocRow::fileSize),
+        NaoUTF::field<NaoUTF::UTF::uInt>("ExtractSize", &TocRow::extractSize),
+        NaoUTF::field<NaoUTF::UTF::uInt>("ID", &TocRow::id));
+
+    // every string in the string table of an @UTF packet, names and all
+    QVector<QByteArray> utfStrings(const QByteArray& packet) {
+        const uchar* data = reinterpret_cast<const uchar*>(packet.constData());
+
+        qint64 begin = qMin<qint64>(NaoBytes::load<quint32, NaoEndian::Big>(data + 12) + 8, packet.size());
+        qint64 end = qBound<qint64>(begin, NaoBytes::load<quint32, NaoEndian::Big>(data + 16) + 8, packet.size());
+
+        QVector<QByteArray> strings;
+
+        while (begin < end) {
+            const char* start = packet.constData() + begin;
+            const char* null = static_cast<const char*>(memchr(start, '\0', end - begin));
+            qint64 size = null ? (null - start) : (end - begin);
+
+            strings.append(QByteArray(start, static_cast<int>(size)));
+            begin += size + 1;
+        }
+
+        return strings;
+    }
+
+    // where code page 932 and a JIS based Shift-JIS codec are allowed to disagree, see NaoText::fromShiftJIS
+    bool cp932Differs(int code) {
+        const int lead = code >> 8;
+
+        switch (code) {
+            case 0x5C: case 0x7E:                               // yen sign and overline in JIS-Roman
+            case 0x815F: case 0x8160: case 0x8161: case 0x817C: // backslash, wave dash, double vertical line, minus
+            case 0x8191: case 0x8192: case 0x81CA:              // cent, pound, not
+                return true;
+        }
+
+        // NEC row 13, the IBM extensions (both copies) and the user defined area, which cp932 maps to the PUA
+
+        return lead == 0x87 || lead == 0xED || lead == 0xEE || (lead >= 0xF0 && lead <= 0xFC);
+    }
+
+    // NaoText replaced QTextCodec for @UTF strings, so every single byte and every pair has to decode the same
+    // through both, except for what cp932Differs() lists
+    void checkShiftJIS(QTextCodec* codec) {
+        if (!codec) {
+            return;
+        }
+
+        // a character both of them decode, or nothing if either doesn't (QTextCodec may not even agree on how many
+        // bytes it skips), and that's the same as far as this is concerned
+
+        auto decoded = [](const QString& str) {
+            return (str.size() == 1 && str.at(0) != QChar::ReplacementCharacter) ? str : QString();
+        };
+
+        auto check = [&](int code, const QByteArray& bytes) {
+            const QString ours = decoded(NaoText::fromShiftJIS(bytes.constData(), bytes.size()));
+            const QString theirs = decoded(codec->toUnicode(bytes));
+
+            if (ours != theirs && !cp932Differs(code)) {
+                qFatal("Shift-JIS: 0x%X decodes to U+%04X, QTextCodec has U+%04X", code,
+                       ours.isEmpty() ? 0xFFFD : ours.at(0).unicode(), theirs.isEmpty() ? 0xFFFD : theirs.at(0).unicode());
+            }
+        };
+
+        for (int b = 0; b < 0x100; ++b) {
+            if (b < 0x80 || (b >= 0xA1 && b <= 0xDF)) {
+                check(b, QByteArray(1, static_cast<char>(b)));
+            }
+        }
+
+        for (int lead = 0x81; lead <= 0xFC; ++lead) {
+            if (lead > 0x9F && lead < 0xE0) {
+                continue;
+            }
+
+            for (int trail = 0x40; trail <= 0xFC; ++trail) {
+                if (trail != 0x7F) {
+                    const char pair[2] = { static_cast<char>(lead), static_cast<char>(trail) };
+                    check((lead << 8) | trail, QByteArray(pair, 2));
+                }
+            }
+        }
+    }
+
+    // primitive NaoFileReader reads, both from the mapping and through the read-ahead buffer
+
+    void benchReader(const Context& ctx) {
+        const qint64 block = 0x10000;
+
+        NaoFileReader mapped(ctx.cpk);
+
+        QFile file(ctx.cpk);
+        file.open(QIODevice::ReadOnly);
+        NaoFileReader buffered(&file);
+
+        const qint64 blocks = qMin(mapped.size() / block, ctx.ops);
+
+        for (NaoFileReader* reader : { &mapped, &buffered }) {
+            QString kind = reader->isMapped() ? "mapped" : "buffered";
+
+            ctx.report(run("reader/read<u32> " + kind, 1, blocks, [&](int, qint64 i) {
+                reader->seek(i * block);
+
+                quint32 sum = 0;
+
+                for (qint64 j = 0; j < block / 4; ++j) {
+                    sum += reader->readUIntBE();
+                }
+
+                consume(sum);
+
+                return block;
+            }));
+
+            ctx.report(run("reader/read(4K) " + kind, 1, blocks, [&](int, qint64 i) {
+                reader->seek(i * block);
+
+                for (qint64 j = 0; j < block / 0x1000; ++j) {
+                    consume(reader->read(0x1000).size());
+                }
+
+                return block;
+            }));
+
+            QVector<quint32> table(block / 4);
+
+            ctx.report(run("reader/readArray<u32> " + kind, 1, blocks, [&](int, qint64 i) {
+                reader->seek(i * block);
+                reader->readArray<quint32, NaoEndian::Big>(table.size(), table.data());
+
+                consume(table.at(0));
+
+                return block;
+            }));
+        }
+
+        // 4 KiB at random offsets, shared between all threads
+
+        for (NaoFileReader* reader : { &mapped, &buffered }) {
+            QString kind = reader->isMapped() ? "mapped" : "pread";
+
+            for (int threads : ctx.threads) {
+                QVector<QByteArray> buffers(threads, QByteArray(0x1000, '\0'));
+
+                ctx.report(run("reader/readAt(4K) " + kind, threads, ctx.ops * 16, [&](int thread, qint64 i) {
+                    Random rand(i);
+                    qint64 offset = rand.bounded(reader->size() - 0x1000) & ~0xFFFLL;
+
+                    return reader->readAt(offset, 0x1000, buffers[thread].data());
+                }));
+            }
+        }
+    }
+
+    void benchUTF(const Context& ctx) {
+        NaoFileReader reader(ctx.cpk);
+
+        QByteArray toc = reader.readAt(ctx.layout.tocOffset, ctx.layout.tocSize);
+        const qint64 rows = ctx.spec.entries;
+
+        // keep the amount of rows parsed roughly constant over archive sizes
+
+        ctx.report(run("utf/parse TOC", 1, qBound<qint64>(3, 4000000 / qMax<qint64>(rows, 1), ctx.ops), [&](int, qint64) {
+            NaoCRIWareReader::UTFReader utf(toc);
+            consume(utf.getRowCount());
+
+            return toc.size();
+        }));
+
+        ctx.report(run("utf/parse TOC lazy", 1, qBound<qint64>(3, 4000000 / qMax<qint64>(rows, 1), ctx.ops), [&](int, qint64) {
+            NaoCRIWareReader::UTFReader utf(toc, NaoCRIWareReader::UTFReader::Lazy);
+            consume(utf.getRowCount());
+
+            return toc.size();
+        }));
+
+        // a few cells of a big table: Lazy only decodes the strings it reads, so this shouldn't grow with the table
+
+        for (NaoCRIWareReader::UTFReader::Decoding decoding : { NaoCRIWareReader::UTFReader::Eager, NaoCRIWareReader::UTFReader::Lazy }) {
+            const QString name = (decoding == NaoCRIWareReader::UTFReader::Lazy) ? "utf/few cells TOC lazy" : "utf/few cells TOC";
+
+            ctx.report(run(name, 1, qBound<qint64>(3, 4000000 / qMax<qint64>(rows, 1), ctx.ops), [&](int, qint64) {
+                NaoCRIWareReader::UTFReader utf(toc, decoding);
+
+                const int fileName = utf.column("FileName");
+                const int dirName = utf.column("DirName");
+
+                quint64 sum = 0;
+
+                for (quint32 row = 0; row < qMin<quint32>(16, utf.getRowCount()); ++row) {
+                    sum += utf.stringAt(dirName, row).size();
+                    sum += utf.stringAt(fileName, row).size();
+                }
+
+                consume(sum);
+
+                return 0;
+            }));
+        }
+
+        if (ctx.layout.etocSize > 0) {
+            QByteArray etoc = reader.readAt(ctx.layout.etocOffset, ctx.layout.etocSize);
+
+            ctx.report(run("utf/parse ETOC", 1, qBound<qint64>(3, 4000000 / qMax<qint64>(rows, 1), ctx.ops), [&](int, qint64) {
+                NaoCRIWareReader::UTFReader utf(etoc);
+                consume(utf.getRowCount());
+
+                return etoc.size();
+            }));
+        }
+
+        // a full pass over the TOC by name, the way the archive reader does it
+
+        NaoCRIWareReader::UTFReader utf(toc);
+
+        ctx.report(run("utf/getFieldData TOC pass", 1, qBound<qint64>(3, 4000000 / qMax<qint64>(rows, 1), ctx.ops), [&](int, qint64) {
+            quint64 sum = 0;
+
+            for (quint32 row = 0; row < utf.getRowCount(); ++row) {
+                sum += utf.getFieldData(row, "FileOffset").toULongLong();
+                sum += utf.getFieldData(row, "FileName").toString().size();
+            }
+
+            consume(sum);
+
+            return 0;
+        }));
+
+        // the same pass through the typed accessors
+
+        ctx.report(run("utf/typed TOC pass", 1, qBound<qint64>(3, 4000000 / qMax<qint64>(rows, 1), ctx.ops), [&](int, qint64) {
+            const int fileOffset = utf.column("FileOffset");
+            const int fileName = utf.column("FileName");
+
+            quint64 sum = 0;
+
+            for (quint32 row = 0; row < utf.getRowCount(); ++row) {
+                sum += utf.u64At(fileOffset, row);
+                sum += utf.stringAt(fileName, row).size();
+            }
+
+            consume(sum);
+
+            return 0;
+        }));
+
+        // the whole TOC into structs at once, from a lazy reader like NaoCRIWareReader does it
+
+        ctx.report(run("utf/schema TOC lazy", 1, qBound<qint64>(3, 4000000 / qMax<qint64>(rows, 1), ctx.ops), [&](int, qint64) {
+            NaoCRIWareReader::UTFReader lazy(toc, NaoCRIWareReader::UTFReader::Lazy);
+            consume(tocSchema.decode(lazy).size());
+
+            return toc.size();
+        }));
+
+        // the same rows through the typed accessors, for comparison
+
+        ctx.report(run("utf/typed TOC lazy", 1, qBound<qint64>(3, 4000000 / qMax<qint64>(rows, 1), ctx.ops), [&](int, qint64) {
+            NaoCRIWareReader::UTFReader lazy(toc, NaoCRIWareReader::UTFReader::Lazy);
+
+            const int fileName = lazy.column("FileName");
+            const int dirName = lazy.column("DirName");
+            const int fileOffset = lazy.column("FileOffset");
+            const int fileSize = lazy.column("FileSize");
+            const int extractSize = lazy.column("ExtractSize");
+            const int id = lazy.column("ID");
+
+            QVector<TocRow> out(static_cast<int>(lazy.getRowCount()));
+
+            for (quint32 row = 0; row < lazy.getRowCount(); ++row) {
+                TocRow& r = out[static_cast<int>(row)];
+                r.fileName = lazy.stringAt(fileName, row);
+                r.dirName = lazy.stringAt(dirName, row);
+                r.fileOffset = lazy.u64At(fileOffset, row);
+                r.fileSize = static_cast<quint32>(lazy.u64At(fileSize, row));
+                r.extractSize = static_cast<quint32>(lazy.u64At(extractSize, row));
+                r.id = static_cast<quint32>(lazy.u64At(id, row));
+            }
+
+            consume(out.size());
+
+            return toc.size();
+        }));
+
+        // just the string tables, through QTextCodec like they used to be and through NaoText. the archive's own TOC
+        // only has ASCII names, the other one is mostly Shift-JIS like a Japanese game's
+
+        QTextCodec* codec = QTextCodec::codecForName("Shift-JIS");
+
+        checkShiftJIS(codec);
+
+        for (const QString& kind : { QString("ascii"), QString("sjis") }) {
+            QVector<QByteArray> strings = utfStrings((kind == "ascii") ? toc : makeJapaneseTOC(static_cast<quint32>(rows), ctx.spec.seed));
+            qint64 bytes = 0;
+
+            for (const QByteArray& str : strings) {
+                bytes += str.size();
+            }
+
+            ctx.report(run("utf/strings QTextCodec " + kind, 1, qBound<qint64>(3, 4000000 / qMax<qint64>(rows, 1), ctx.ops), [&](int, qint64) {
+                quint64 sum = 0;
+
+                for (const QByteArray& str : strings) {
+                    sum += codec->toUnicode(str.constData(), str.size()).size();
+                }
+
+                consume(sum);
+
+                return bytes;
+            }));
+
+            ctx.report(run("utf/strings NaoText " + kind, 1, qBound<qint64>(3, 4000000 / qMax<qint64>(rows, 1), ctx.ops), [&](int, qint64) {
+                quint64 sum = 0;
+
+                for (const QByteArray& str : strings) {
+                    sum += NaoText::fromShiftJIS(str.constData(), str.size()).size();
+                }
+
+                consume(sum);
+
+                return bytes;
+            }));
+        }
+    }
+
+    void benchOpen(const Context& ctx) {
+        const qint64 ops = qMax<qint64>(5, ctx.ops / 10);
+
+        ctx.report(run("open/cpk", 1, ops, [&](int, qint64) {
+            NaoCRIWareReader reader(ctx.cpk);
+            consume(reader.getFiles().size());
+
+            return 0;
+        }));
+
+        // resolving IDs the way a game (or an asset server) addresses entries
+
+        NaoCRIWareReader opened(ctx.cpk);
+
+        ctx.report(run("open/findById", 1, ctx.ops * 1000, [&](int, qint64 i) {
+            Random rand(i);
+            consume(static_cast<quint64>(opened.findById(static_cast<quint32>(rand.bounded(ctx.spec.entries)))));
+
+            return 0;
+        }));
+
+        // the same by path, and listing a directory
+
+        ctx.report(run("open/findByPath", 1, ctx.ops * 100, [&](int, qint64 i) {
+            Random rand(i);
+            const NaoCRIWareReader::EmbeddedFile& file = opened.getFiles().at(static_cast<int>(rand.bounded(ctx.spec.entries)));
+            consume(static_cast<quint64>(opened.findByPath(file.path + '/' + file.name)));
+
+            return 0;
+        }));
+
+        ctx.report(run("open/list dir", 1, ctx.ops * 100, [&](int, qint64 i) {
+            const NaoPathIndex& index = opened.pathIndex();
+            const int dir = static_cast<int>(Random(i).bounded(static_cast<quint64>(index.dirs().size())));
+
+            quint64 sum = 0;
+
+            for (int j = 0; j < index.dirs().at(dir).entryCount; ++j) {
+                sum += static_cast<quint64>(index.entries().at(index.dirs().at(dir).firstEntry + j));
+            }
+
+            consume(sum);
+
+            return 0;
+        }));
+
+        // one directory (of 256 entries) out of the whole archive, and only the columns needed to extract it
+
+        NaoCRIWareReader::OpenOptions options;
+        options.dirFilter = "data/dir0000";
+        options.columns = 0;
+
+        ctx.report(run("open/cpk one dir", 1, ops, [&](int, qint64) {
+            NaoCRIWareReader reader(ctx.cpk, options);
+            consume(reader.getFiles().size());
+
+            return 0;
+        }));
+
+        options.dirFilter.clear();
+        options.nameFilter = "*0.bin";
+
+        ctx.report(run("open/cpk glob", 1, ops, [&](int, qint64) {
+            NaoCRIWareReader reader(ctx.cpk, options);
+            consume(reader.getFiles().size());
+
+            return 0;
+        }));
+
+        if (!ctx.dat.isEmpty()) {
+            ctx.report(run("open/dat", 1, ops, [&](int, qint64) {
+                NaoDATReader reader(ctx.dat);
+                consume(reader.getFiles().size());
+
+                return 0;
+            }));
+        }
+
+        ctx.report(run("open/usm", 1, ops, [&](int, qint64) {
+            NaoCRIWareReader reader(ctx.usm);
+            consume(reader.getFiles().size());
+
+            return 0;
+        }));
+
+        // again from an index cache, it's written by the first open so every measured one is a hit
+
+        QTemporaryDir cacheDir;
+        NaoIndexCache cache(cacheDir.path());
+
+        NaoCRIWareReader::OpenOptions cached;
+        cached.cache = &cache;
+
+        consume(NaoCRIWareReader(ctx.cpk, cached).getFiles().size());
+
+        ctx.report(run("open/cpk cached", 1, ops, [&](int, qint64) {
+            NaoCRIWareReader reader(ctx.cpk, cached);
+            consume(reader.getFiles().size());
+
+            return 0;
+        }));
+
+        if (!ctx.dat.isEmpty()) {
+            NaoDATReader::OpenOptions datCached;
+            datCached.cache = &cache;
+
+            consume(NaoDATReader(ctx.dat, datCached).getFiles().size());
+
+            ctx.report(run("open/dat cached", 1, ops, [&](int, qint64) {
+                NaoDATReader reader(ctx.dat, datCached);
+                consume(reader.getFiles().size());
+
+                return 0;
+            }));
+        }
+
+        consume(NaoCRIWareReader(ctx.usm, cached).getFiles().size());
+
+        ctx.report(run("open/usm cached", 1, ops, [&](int, qint64) {
+            NaoCRIWareReader reader(ctx.usm, cached);
+            consume(reader.getFiles().size());
+
+            return 0;
+        }));
+    }
+
+    void benchExtract(const Context& ctx) {
+        NaoCRIWareReader cpk(ctx.cpk);
+        cpk.setIOPolicy(ctx.policy);
+
+        const QVector<NaoCRIWareReader::EmbeddedFile>& files = cpk.getFiles();
+
+        QVector<qint64> stored;
+        QVector<qint64> compressed;
+
+        for (int i = 0; i < files.size(); ++i) {
+            ((files.at(i).size == files.at(i).extractedSize) ? stored : compressed).append(i);
+        }
+
+        // single entries, one at a time
+
+        ctx.report(run("extract/cpk stored", 1, qMin<qint64>(stored.size(), ctx.ops), [&](int, qint64 i) {
+            return cpk.extractFileAt(stored.at(i)).size();
+        }));
+
+        ctx.report(run("extract/cpk stored view", 1, qMin<qint64>(stored.size(), ctx.ops), [&](int, qint64 i) {
+            return cpk.viewFileAt(stored.at(i)).size();
+        }));
+
+        ctx.report(run("extract/cpk compressed", 1, qMin<qint64>(compressed.size(), ctx.ops), [&](int, qint64 i) {
+            return cpk.extractFileAt(compressed.at(i)).size();
+        }));
+
+        // every entry to a device, over all thread counts
+
+        for (int threads : ctx.threads) {
+            QVector<NullDevice*> sinks;
+
+            for (int t = 0; t < threads; ++t) {
+                sinks.append(new NullDevice());
+            }
+
+            ctx.report(run("extract/cpk all to device", threads, files.size(), [&](int thread, qint64 i) {
+                return cpk.extractFileTo(i, sinks[thread]) ? files.at(i).extractedSize : 0;
+            }));
+
+            qDeleteAll(sinks);
+        }
+
+        // the batch API: one sequential pass over the archive, decompression on the pool. one op is the whole archive
+
+        qint64 totalSize = 0;
+
+        for (const NaoCRIWareReader::EmbeddedFile& file : files) {
+            totalSize += file.extractedSize;
+        }
+
+        QVector<qint64> all;
+
+        for (int i = 0; i < files.size(); ++i) {
+            all.append(i);
+        }
+
+        for (int threads : ctx.threads) {
+            Result result = run("extract/cpk batch", 1, 1, [&](int, qint64) {
+                bool ok = cpk.extractFiles(all, [](qint64) {
+                    return new NullDevice();
+                }, nullptr, threads);
+
+                return ok ? totalSize : 0;
+            });
+
+            result.threads = threads;
+            ctx.report(result);
+        }
+
+        if (!ctx.dat.isEmpty()) {
+            NaoDATReader dat(ctx.dat);
+            dat.setIOPolicy(ctx.policy);
+
+            const QVector<NaoDATReader::EmbeddedFile>& datFiles = dat.getFiles();
+
+            for (int threads : ctx.threads) {
+                QVector<NullDevice*> sinks;
+
+                for (int t = 0; t < threads; ++t) {
+                    sinks.append(new NullDevice());
+                }
+
+                ctx.report(run("extract/dat all to device", threads, datFiles.size(), [&](int thread, qint64 i) {
+                    return dat.extractFileTo(i, sinks[thread]) ? qint64(datFiles.at(i).size) : 0;
+                }));
+
+                qDeleteAll(sinks);
+            }
+        }
+
+        NaoCRIWareReader usm(ctx.usm);
+        const qint64 streams = usm.getFiles().size();
+
+        ctx.report(run("extract/usm streams", 1, streams * qMax<qint64>(1, ctx.ops / 100), [&](int, qint64 i) {
+            return usm.extractFileAt(i % streams).size();
+        }));
+    }
+
+    // the CRILAYLA decoder as it was before it read the bitstream a word at a time: one getBits() call per field,
+    // a byte at a time. slow, but it's what the new decoder has to agree with
+    QByteArray referenceCRILAYLA(const QByteArray& blob) {
+        const uchar* data = reinterpret_cast<const uchar*>(blob.constData());
+
+        if (blob.size() < 0x110 || blob.left(8) != QByteArray("CRILAYLA", 8)) {
+            return QByteArray();
+        }
+
+        const quint32 expectedSize = NaoBytes::load<quint32, NaoEndian::Little>(data + 8);
+        const quint32 headerOffset = NaoBytes::load<quint32, NaoEndian::Little>(data + 12);
+
+        if (static_cast<qint64>(headerOffset) + 0x110 > blob.size()) {
+            return QByteArray();
+        }
+
+        QByteArray result(static_cast<int>(expectedSize + 0x100), '\0');
+        uchar* out = reinterpret_cast<uchar*>(result.data());
+
+        memcpy(out, data + headerOffset + 0x10, 0x100);
+
+        qint64 inputOffset = blob.size() - 0x101;
+        uchar bitpool = 0;
+        int remaining = 0;
+
+        auto getBits = [&](int bits) {
+            quint32 output = 0;
+
+            for (int outbits = 0; outbits < bits;) {
+                if (remaining == 0) {
+                    bitpool = data[inputOffset--];
+                    remaining = 8;
+                }
+
+                const int now = qMin(remaining, bits - outbits);
+
+                output = (output << now) | ((bitpool >> (remaining - now)) & ((1U << now) - 1));
+                remaining -= now;
+                outbits += now;
+            }
+
+            return output;
+        };
+
+        const qint64 outputEnd = 0xFF + static_cast<qint64>(expectedSize);
+        qint64 outputSize = 0;
+        constexpr int levels[4] = { 2, 3, 5, 8 };
+
+        while (outputSize < expectedSize) {
+            if (getBits(1)) {
+                qint64 from = outputEnd - outputSize + getBits(13) + 3;
+                qint64 length = 3;
+                int level;
+
+                for (level = 0; level < 4; level++) {
+                    const quint32 thisLevel = getBits(levels[level]);
+                    length += thisLevel;
+
+                    if (thisLevel != ((1U << levels[level]) - 1)) {
+                        break;
+                    }
+                }
+
+                if (level == 4) {
+                    quint32 thisLevel;
+
+                    do {
+                        thisLevel = getBits(8);
+                        length += thisLevel;
+                    } while (thisLevel == 0xFF);
+                }
+
+                for (qint64 i = 0; i < length; i++) {
+                    out[outputEnd - outputSize] = out[from--];
+                    outputSize++;
+                }
+            } else {
+                out[outputEnd - outputSize] = static_cast<uchar>(getBits(8));
+                outputSize++;
+            }
+        }
+
+        return result;
+    }
+
+    // every blob has to decode to the same bytes with the reference decoder, the current one and decompressing into
+    // a buffer, and to what was compressed in the first place
+    void checkCRILAYLA(const QVector<QByteArray>& raw, const QVector<QByteArray>& compressed, const char* what) {
+        for (int i = 0; i < raw.size(); ++i) {
+            const QByteArray& blob = compressed.at(i);
+            const uchar* in = reinterpret_cast<const uchar*>(blob.constData());
+
+            QByteArray into(qMax(raw.at(i).size(), 1), Qt::Uninitialized);
+            const bool decoded = NaoCRILAYLA::decompress(in, blob.size(), reinterpret_cast<uchar*>(into.data()), into.size());
+            into.resize(raw.at(i).size());
+
+            if (referenceCRILAYLA(blob) != raw.at(i) || NaoCRIWareReader::decompressCRILAYLA(blob) != raw.at(i)
+                || !decoded || into != raw.at(i)) {
+                qFatal("CRILAYLA: %s %d (0x%x bytes) doesn't decode to what was compressed", what, i, raw.at(i).size());
+            }
+        }
+    }
+
+    // inputs that take the encoder down its less travelled paths
+    QVector<QByteArray> crilaylaEdgeCases(quint64 seed) {
+        QVector<QByteArray> cases;
+
+        // nothing to match at all, only the prefix, and one byte past it
+
+        cases.append(entryData(seed, 0, 0x10000, false));
+        cases.append(entryData(seed, 1, 0x100, false));
+        cases.append(entryData(seed, 2, 0x101, false));
+
+        // one long run, every match overlaps itself
+
+        cases.append(QByteArray(0x40100, '\0'));
+
+        // the same bytes exactly maxDistance apart (the furthest a match reaches) and one further than that
+
+        for (qint64 distance : { NaoCRILAYLA::maxDistance, NaoCRILAYLA::maxDistance + 1 }) {
+            QByteArray data = entryData(seed, 3, 0x100 + distance + 0x40, false);
+            memcpy(data.data() + 0x100 + distance, data.constData() + 0x100, 0x40);
+
+            cases.append(data);
+        }
+
+        // matches just below, at and past every step of the length ladder (2, 3, 5 and 8 bits, then 0xFF bytes).
+        // a run is 3 literals (matches reach back at least 3 bytes) and a match for the rest
+
+        QByteArray ladder = entryData(seed, 4, 0x100, false);
+        Random rand(seed);
+
+        for (int length : { 3, 5, 6, 7, 12, 13, 14, 43, 44, 45, 298, 299, 300, 553, 554, 555, 1000, 0x10000 }) {
+            ladder.append(QByteArray(length + 3, static_cast<char>(length)));
+
+            char noise[8];
+            rand.fill(noise, sizeof(noise));
+            ladder.append(noise, sizeof(noise));
+        }
+
+        cases.append(ladder);
+
+        // big enough that the encoder's window moves a lot
+
+        cases.append(entryData(seed, 5, 0x400000, true));
+
+        return cases;
+    }
+
+    void benchCRILAYLA(const Context& ctx) {
+
+        // both modes have to give back exactly what they got, and data shorter than the prefix can't be compressed
+
+        const QVector<QByteArray> edges = crilaylaEdgeCases(ctx.spec.seed);
+
+        for (NaoCRILAYLA::Mode mode : { NaoCRILAYLA::Greedy, NaoCRILAYLA::Optimal }) {
+            const char* what = (mode == NaoCRILAYLA::Greedy) ? "greedy edge case" : "optimal edge case";
+
+            checkCRILAYLA(edges, NaoCRILAYLA::compress(edges, mode), what);
+
+            for (int size : { 0, 1, 0xFF }) {
+                if (!NaoCRILAYLA::compress(QByteArray(size, 'a'), mode).isEmpty()) {
+                    qFatal("CRILAYLA: %s of 0x%x bytes is shorter than the prefix but was compressed", what, size);
+                }
+            }
+        }
+
+        // an in-memory corpus, so this only measures the codec
+
+        QVector<QByteArray> raw;
+        Random rand(ctx.spec.seed);
+
+        for (quint32 i = 0; i < 32; ++i) {
+            raw.append(entryData(ctx.spec.seed, i, rand.sizeBetween(0x10000, 0x100000), true));
+        }
+
+        QVector<QByteArray> corpus = NaoCRILAYLA::compress(raw);
+
+        // none of the numbers mean anything if it doesn't decode right. the corpus has plenty of overlapping matches
+        // (runs in the text), and the prefix is copied separately from the bitstream
+
+        checkCRILAYLA(raw, corpus, "corpus entry");
+
+        for (int threads : ctx.threads) {
+            ctx.report(run("crilayla/decompress", threads, ctx.ops, [&](int, qint64 i) {
+                return NaoCRIWareReader::decompressCRILAYLA(corpus.at(i % corpus.size())).size();
+            }));
+        }
+
+        // same thing into one reused buffer per thread, no allocations
+
+        for (int threads : ctx.threads) {
+            QVector<QByteArray> buffers;
+
+            for (int t = 0; t < threads; ++t) {
+                buffers.append(QByteArray(0x100100, Qt::Uninitialized));
+            }
+
+            ctx.report(run("crilayla/decompress into", threads, ctx.ops, [&](int thread, qint64 i) {
+                const QByteArray& blob = corpus.at(i % corpus.size());
+                const uchar* in = reinterpret_cast<const uchar*>(blob.constData());
+                uchar* out = reinterpret_cast<uchar*>(buffers[thread].data());
+
+                if (!NaoCRILAYLA::decompress(in, blob.size(), out, buffers[thread].size())) {
+                    return qint64(0);
+                }
+
+                return NaoCRILAYLA::decompressedSize(in, blob.size());
+            }));
+        }
+
+        // compression throughput is in input bytes, optimal parsing is a lot slower so it gets fewer ops
+
+        for (int threads : ctx.threads) {
+            ctx.report(run("crilayla/compress greedy", threads, ctx.ops, [&](int, qint64 i) {
+                const QByteArray& data = raw.at(i % raw.size());
+                consume(NaoCRILAYLA::compress(data, NaoCRILAYLA::Greedy).size());
+
+                return static_cast<qint64>(data.size());
+            }));
+        }
+
+        for (int threads : ctx.threads) {
+            ctx.report(run("crilayla/compress optimal", threads, qMax<qint64>(1, ctx.ops / 8), [&](int, qint64 i) {
+                const QByteArray& data = raw.at(i % raw.size());
+                consume(NaoCRILAYLA::compress(data, NaoCRILAYLA::Optimal).size());
+
+                return static_cast<qint64>(data.size());
+            }));
+        }
+
+        // the batch API doing its own threading, one op is the whole corpus
+
+        qint64 rawSize = 0;
+
+        for (const QByteArray& data : raw) {
+            rawSize += data.size();
+        }
+
+        for (int threads : ctx.threads) {
+            Result result = run("crilayla/compress batch", 1, qMax<qint64>(1, ctx.ops / raw.size()), [&](int, qint64) {
+                consume(NaoCRILAYLA::compress(raw, NaoCRILAYLA::Greedy, threads).size());
+
+                return rawSize;
+            });
+
+            result.threads = threads;
+            ctx.report(result);
+        }
+    }
+
+    void benchVDF(const Context& ctx) {
+        QByteArray vdf = makeVDF(16, 500, ctx.spec.seed);
+        std::string text(vdf.constData(), vdf.size());
+
+        ctx.report(run("vdf/parse libraryfolders", 1, ctx.ops, [&](int, qint64) {
+            tyti::vdf::object root = tyti::vdf::read(text.begin(), text.end());
+            consume(root.childs.size());
+
+            return static_cast<qint64>(text.size());
+        }));
+    }
+}
+
+int main(int argc, char *argv[]) {
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("naobench");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("libnao benchmarks on deterministic synthetic archives");
+    parser.addHelpOption();
+
+    QCommandLineOption dirOption("dir", "Where to generate the inputs (kept afterwards), a temporary directory by default.", "path");
+    QCommandLineOption entriesOption("entries", "Entries in the CPK and DAT archives.", "n", "10000");
+    QCommandLineOption minSizeOption("min-size", "Smallest entry size in bytes.", "bytes", "256");
+    QCommandLineOption maxSizeOption("max-size", "Largest entry size in bytes.", "bytes", "1048576");
+    QCommandLineOption compressedOption("compressed", "Percentage of CPK entries stored as CRILAYLA.", "percent", "40");
+    QCommandLineOption chunksOption("usm-chunks", "Data chunks per USM stream.", "n", "2000");
+    QCommandLineOption threadsOption("threads", "Thread counts for the scaling runs, comma separated.", "list");
+    QCommandLineOption opsOption("ops", "Operations per benchmark (some scale this up or down).", "n", "1000");
+    QCommandLineOption seedOption("seed", "Seed for the generators.", "n", "1");
+    QCommandLineOption blockOption("copy-block", "Copy block size for extraction to a device.", "bytes", "4194304");
+    QCommandLineOption directOption("direct", "Extract entries of at least this size with O_DIRECT, 0 disables.", "bytes", "0");
+    QCommandLineOption dropOption("drop-cache", "Evict extracted ranges from the page cache.");
+    QCommandLineOption groupsOption("only", "Only run these groups: reader, utf, open, extract, crilayla, vdf.", "list");
+
+    parser.addOptions({ dirOption, entriesOption, minSizeOption, maxSizeOption, compressedOption,
+                        chunksOption, threadsOption, opsOption, seedOption, blockOption,
+                        directOption, dropOption, groupsOption });
+    parser.process(app);
+
+    QTextStream out(stdout);
+
+    Context ctx;
+    ctx.out = &out;
+    ctx.ops = qMax(1LL, parser.value(opsOption).toLongLong());
+    ctx.spec.entries = parser.value(entriesOption).toUInt();
+    ctx.spec.minSize = parser.value(minSizeOption).toULongLong();
+    ctx.spec.maxSize = parser.value(maxSizeOption).toULongLong();
+    ctx.spec.compressedPercent = parser.value(compressedOption).toUInt();
+    ctx.spec.seed = parser.value(seedOption).toULongLong();
+    ctx.policy.copyBlockSize = parser.value(blockOption).toLongLong();
+    ctx.policy.directThreshold = parser.value(directOption).toLongLong();
+    ctx.policy.dropAfterCopy = parser.isSet(dropOption);
+
+    if (parser.isSet(groupsOption)) {
+        ctx.groups = parser.value(groupsOption).split(',', QString::SkipEmptyParts);
+    }
+
+    if (parser.isSet(threadsOption)) {
+        for (const QString& t : parser.value(threadsOption).split(',', QString::SkipEmptyParts)) {
+            ctx.threads.append(qMax(1, t.toInt()));
+        }
+    } else {
+        for (int t = 1; t < QThread::idealThreadCount(); t *= 2) {
+            ctx.threads.append(t);
+        }
+
+        ctx.threads.append(QThread::idealThreadCount());
+    }
+
+    USMSpec usmSpec;
+    usmSpec.chunks = parser.value(chunksOption).toUInt();
+    usmSpec.seed = ctx.spec.seed;
+
+    QTemporaryDir temp;
+    QDir dir(parser.isSet(dirOption) ? parser.value(dirOption) : temp.path());
+    dir.mkpath(".");
+
+    ctx.cpk = dir.filePath("bench.cpk");
+    ctx.dat = dir.filePath("bench.dat");
+    ctx.usm = dir.filePath("bench.usm");
+
+    // generate everything up front, so none of it ends up in the numbers
+
+    QElapsedTimer timer;
+    timer.start();
+
+    if (!writeCPK(ctx.cpk, ctx.spec, &ctx.layout)) {
+        qFatal("Could not write %s", qPrintable(ctx.cpk));
+    }
+
+    // DAT offsets are 32 bits, so big runs go without
+
+    if (!writeDAT(ctx.dat, ctx.spec)) {
+        out << "skipping DAT: does not fit in 4 GiB" << endl;
+        ctx.dat.clear();
+    }
+
+    if (!writeUSM(ctx.usm, usmSpec)) {
+        qFatal("Could not write %s", qPrintable(ctx.usm));
+    }
+
+    out << QString("generated in %1 s: cpk %2 (%3 entries, %4 CRILAYLA), dat %5, usm %6")
+           .arg(timer.elapsed() / 1000., 0, 'f', 1)
+           .arg(QFileInfo(ctx.cpk).size())
+           .arg(ctx.spec.entries)
+           .arg(ctx.layout.compressed)
+           .arg(ctx.dat.isEmpty() ? 0 : QFileInfo(ctx.dat).size())
+           .arg(QFileInfo(ctx.usm).size()) << endl << endl;
+
+    printHeader(out);
+
+    if (ctx.wants("reader")) {
+        benchReader(ctx);
+    }
+
+    if (ctx.wants("utf")) {
+        benchUTF(ctx);
+    }
+
+    if (ctx.wants("open")) {
+        benchOpen(ctx);
+    }
+
+    if (ctx.wants("extract")) {
+        benchExtract(ctx);
+    }
+
+    if (ctx.wants("crilayla")) {
+        benchCRILAYLA(ctx);
+    }
+
+    if (ctx.wants("vdf")) {
+        benchVDF(ctx);
+    }
+
+    return 0;
+}
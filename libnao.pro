@@ -0,0 +1,9 @@
+# builds the library and the benchmarks next to each other
+
+TEMPLATE = subdirs
+
+SUBDIRS = \
+    libnao \
+    bench
+
+bench.depends = libnao
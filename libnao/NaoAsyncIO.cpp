@@ -0,0 +1,415 @@
+#include "NaoAsyncIO.h"
+#include "NaoFileReader.h"
+
+#include <QThreadPool>
+#include <QRunnable>
+#include <QThread>
+#include <QMutexLocker>
+
+#if defined(Q_OS_LINUX) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define LIBNAO_IO_URING
+#endif
+#endif
+
+#ifdef LIBNAO_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+// thread pool fallback: every read is a readAt() on a pool thread
+
+class NaoAsyncRead : public QRunnable {
+    public:
+    NaoAsyncRead(NaoAsyncIO* io, qint64 offset, qint64 len, char* buffer, quint64 tag) :
+        _io(io), _offset(offset), _len(len), _buffer(buffer), _tag(tag) { }
+
+    void run() override {
+        qint64 result = _io->_reader->readAt(_offset, _len, _buffer);
+
+        QMutexLocker lock(&_io->_lock);
+        _io->_completed.append({ _tag, result });
+        _io->_done.wakeAll();
+    }
+
+    private:
+    NaoAsyncIO* _io;
+    qint64 _offset;
+    qint64 _len;
+    char* _buffer;
+    quint64 _tag;
+};
+
+#ifdef LIBNAO_IO_URING
+
+// a bare io_uring instance driven through the raw syscalls, so we don't depend on liburing
+
+struct NaoAsyncIO::Ring {
+    int fd = -1;
+    int file = -1;
+
+    void* sqMap = nullptr;
+    size_t sqMapSize = 0;
+    void* cqMap = nullptr;
+    size_t cqMapSize = 0;
+    io_uring_sqe* sqes = nullptr;
+    size_t sqesSize = 0;
+
+    unsigned* sqHead;
+    unsigned* sqTail;
+    unsigned sqMask;
+    unsigned* sqArray;
+
+    unsigned* cqHead;
+    unsigned* cqTail;
+    unsigned cqMask;
+    io_uring_cqe* cqes;
+
+    unsigned pending = 0;   // sqes filled in but not yet passed to io_uring_enter
+    unsigned inKernel = 0;  // taken by the kernel, but not yet reaped
+
+    bool setup(unsigned entries, int file) {
+        io_uring_params params;
+        memset(&params, 0, sizeof(params));
+
+        fd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+
+        if (fd < 0) {
+            return false;
+        }
+
+        // IORING_OP_READ came with 5.6, which is also when this feature flag showed up
+
+        if (!(params.features & IORING_FEAT_RW_CUR_POS)) {
+            return false;
+        }
+
+        this->file = file;
+
+        sqMapSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cqMapSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+
+        // newer kernels put both rings in one mapping
+
+        if (params.features & IORING_FEAT_SINGLE_MMAP) {
+            sqMapSize = cqMapSize = qMax(sqMapSize, cqMapSize);
+        }
+
+        sqMap = mmap(nullptr, sqMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+
+        if (sqMap == MAP_FAILED) {
+            sqMap = nullptr;
+            return false;
+        }
+
+        if (params.features & IORING_FEAT_SINGLE_MMAP) {
+            cqMap = sqMap;
+        } else {
+            cqMap = mmap(nullptr, cqMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+
+            if (cqMap == MAP_FAILED) {
+                cqMap = nullptr;
+                return false;
+            }
+        }
+
+        sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+        void* sqeMap = mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+
+        if (sqeMap == MAP_FAILED) {
+            return false;
+        }
+
+        sqes = static_cast<io_uring_sqe*>(sqeMap);
+
+        char* sq = static_cast<char*>(sqMap);
+        sqHead = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+        sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        sqMask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+
+        char* cq = static_cast<char*>(cqMap);
+        cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        cqMask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+
+        return true;
+    }
+
+    ~Ring() {
+        if (sqes) {
+            munmap(sqes, sqesSize);
+        }
+
+        if (cqMap && cqMap != sqMap) {
+            munmap(cqMap, cqMapSize);
+        }
+
+        if (sqMap) {
+            munmap(sqMap, sqMapSize);
+        }
+
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+
+    void queueRead(qint64 offset, qint64 len, char* buffer, quint64 tag) {
+        unsigned tail = *sqTail;
+        unsigned index = tail & sqMask;
+
+        io_uring_sqe* sqe = &sqes[index];
+        memset(sqe, 0, sizeof(*sqe));
+        sqe->opcode = IORING_OP_READ;
+        sqe->fd = file;
+        sqe->off = offset;
+        sqe->addr = reinterpret_cast<quintptr>(buffer);
+        sqe->len = static_cast<unsigned>(len);
+        sqe->user_data = tag;
+
+        sqArray[index] = index;
+
+        // the kernel may only see the new tail once the sqe is written
+
+        __atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+
+        ++pending;
+    }
+
+    int enter(unsigned submit, unsigned min) {
+        int r;
+
+        do {
+            r = static_cast<int>(syscall(__NR_io_uring_enter, fd, submit, min,
+                                         (min > 0) ? IORING_ENTER_GETEVENTS : 0, nullptr, 0));
+        } while (r < 0 && errno == EINTR);
+
+        return r;
+    }
+
+    // pass every pending sqe to the kernel. it may take fewer than asked for, or none at all when it's short on
+    // memory (EAGAIN) or the completion queue is full (EBUSY), so keep going and make room by reaping into done
+    // when that happens. 0 once they're all in, the error if it fails for good (the sqes it never took are
+    // dropped from the ring then)
+    int submitAll(QVector<NaoAsyncIO::Completion>& done) {
+        while (pending > 0) {
+            int r = enter(pending, 0);
+
+            if (r > 0) {
+                pending -= static_cast<unsigned>(r);
+                inKernel += static_cast<unsigned>(r);
+
+                continue;
+            }
+
+            // only worth waiting if something we submitted can still complete
+
+            if ((r == 0 || errno == EAGAIN || errno == EBUSY) && inKernel > 0) {
+                if (enter(0, 1) < 0 && errno != EAGAIN && errno != EBUSY) {
+                    return abandon(errno);
+                }
+
+                reap(done);
+
+                continue;
+            }
+
+            return abandon((r < 0) ? errno : EAGAIN);
+        }
+
+        return 0;
+    }
+
+    // the kernel only reads the ring inside io_uring_enter, so it's safe to take the pending sqes back
+    int abandon(int error) {
+        __atomic_store_n(sqTail, *sqTail - pending, __ATOMIC_RELEASE);
+
+        return error;
+    }
+
+    int reap(QVector<NaoAsyncIO::Completion>& out) {
+        unsigned head = *cqHead;
+        unsigned tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+        int count = 0;
+
+        while (head != tail) {
+            io_uring_cqe* cqe = &cqes[head & cqMask];
+            out.append({ cqe->user_data, cqe->res });
+
+            ++head;
+            ++count;
+        }
+
+        __atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+
+        inKernel -= static_cast<unsigned>(count);
+
+        return count;
+    }
+};
+#else
+struct NaoAsyncIO::Ring { };
+#endif
+
+NaoAsyncIO::NaoAsyncIO(const NaoFileReader* reader, int queueDepth) :
+    _reader(reader),
+    _queueDepth(qMax(queueDepth, 1)) {
+
+#ifdef LIBNAO_IO_URING
+    if (_reader->nativeHandle() >= 0) {
+        _ring = new Ring();
+
+        // setup fails in containers and on old kernels, in which case we quietly use the pool
+
+        if (!_ring->setup(static_cast<unsigned>(_queueDepth), _reader->nativeHandle())) {
+            delete _ring;
+            _ring = nullptr;
+        }
+    }
+#endif
+
+    if (!_ring) {
+        _pool = new QThreadPool();
+        _pool->setMaxThreadCount(qMin(_queueDepth, qMax(QThread::idealThreadCount(), 4)));
+    }
+}
+
+NaoAsyncIO::~NaoAsyncIO() {
+
+    // buffers belong to the caller, so everything in flight has to land before we go
+
+    QVector<Completion> discard;
+
+    if (_inFlight - _queued.size() > 0) {
+        _reap(discard, _inFlight - _queued.size());
+    }
+
+    delete _pool;
+    delete _ring;
+}
+
+NaoAsyncIO::Backend NaoAsyncIO::backend() const {
+    return _ring ? IOUring : ThreadPool;
+}
+
+int NaoAsyncIO::queueDepth() const {
+    return _queueDepth;
+}
+
+int NaoAsyncIO::inFlight() const {
+    return _inFlight;
+}
+
+bool NaoAsyncIO::submitRead(qint64 offset, qint64 len, char* buffer, quint64 tag) {
+
+    // a single io_uring read is limited to 32 bits
+
+    if (_inFlight >= _queueDepth || len < 0 || len > 0x7FFFF000) {
+        return false;
+    }
+
+    _queued.append({ offset, len, buffer, tag });
+    ++_inFlight;
+
+    return true;
+}
+
+int NaoAsyncIO::submit() {
+    int count = _queued.size();
+
+#ifdef LIBNAO_IO_URING
+    if (_ring) {
+        for (const Request& r : _queued) {
+            _ring->queueRead(r.offset, r.len, r.buffer, r.tag);
+        }
+
+        // reads finished while making room go with the next _reap()
+
+        const int error = _ring->submitAll(_completed);
+
+        if (error != 0) {
+            const int failed = static_cast<int>(_ring->pending);
+
+            // the ones the kernel never took complete right away as failed, so nobody waits on them
+
+            for (int i = count - failed; i < count; i++) {
+                _completed.append({ _queued.at(i).tag, -error });
+            }
+
+            _ring->pending = 0;
+            count -= failed;
+        }
+
+        _queued.clear();
+
+        return count;
+    }
+#endif
+
+    for (const Request& r : _queued) {
+        _pool->start(new NaoAsyncRead(this, r.offset, r.len, r.buffer, r.tag));
+    }
+
+    _queued.clear();
+
+    return count;
+}
+
+int NaoAsyncIO::poll(QVector<Completion>& out) {
+    return _reap(out, 0);
+}
+
+int NaoAsyncIO::wait(QVector<Completion>& out, int min) {
+
+    // don't wait on something that was never submitted
+
+    if (!_queued.isEmpty()) {
+        submit();
+    }
+
+    return _reap(out, qMin(min, _inFlight));
+}
+
+int NaoAsyncIO::_reap(QVector<Completion>& out, int min) {
+    int count = 0;
+
+#ifdef LIBNAO_IO_URING
+    if (_ring) {
+        count = _completed.size();
+        out.append(_completed);
+        _completed.clear();
+
+        count += _ring->reap(out);
+
+        while (count < min) {
+            if (_ring->enter(0, static_cast<unsigned>(min - count)) < 0) {
+                break;
+            }
+
+            count += _ring->reap(out);
+        }
+
+        _inFlight -= count;
+
+        return count;
+    }
+#endif
+
+    QMutexLocker lock(&_lock);
+
+    while (_completed.size() < min) {
+        _done.wait(&_lock);
+    }
+
+    count = _completed.size();
+    out.append(_completed);
+    _completed.clear();
+
+    _inFlight -= count;
+
+    return count;
+}
@@ -0,0 +1,82 @@
+#ifndef NAOASYNCIO_H
+#define NAOASYNCIO_H
+
+#include "libnao_global.h"
+
+#include <QVector>
+#include <QMutex>
+#include <QWaitCondition>
+
+class NaoFileReader;
+class QThreadPool;
+
+// Keeps many reads from a NaoFileReader in flight at once.
+// Reads are queued with submitRead(), handed to the backend in batches with submit(),
+// and come back (in any order) through poll() or wait().
+// Uses io_uring on Linux when the reader has a native handle, otherwise a thread pool doing readAt().
+// Not thread-safe itself: one NaoAsyncIO per thread, but any number of them may share a reader.
+
+class LIBNAO_API NaoAsyncIO {
+    public:
+    enum Backend {
+        IOUring = 0,
+        ThreadPool
+    };
+
+    struct Completion {
+        quint64 tag;        // whatever was passed to submitRead
+        qint64 result;      // bytes read, negative on failure
+    };
+
+    NaoAsyncIO(const NaoFileReader* reader, int queueDepth = 32);
+    ~NaoAsyncIO();
+
+    Backend backend() const;
+    int queueDepth() const;
+    int inFlight() const;       // queued or submitted, but not yet reaped
+
+    // queue a read of len bytes at offset into buffer, returns false if the queue is full
+    bool submitRead(qint64 offset, qint64 len, char* buffer, quint64 tag);
+
+    // hand everything queued to the backend, returns how many reads were submitted. reads the backend
+    // couldn't take complete right away with a negative result (-errno)
+    int submit();
+
+    // collect finished reads, poll() never blocks, wait() blocks until at least min are done
+    int poll(QVector<Completion>& out);
+    int wait(QVector<Completion>& out, int min = 1);
+
+    private:
+    Q_DISABLE_COPY(NaoAsyncIO)
+
+    struct Request {
+        qint64 offset;
+        qint64 len;
+        char* buffer;
+        quint64 tag;
+    };
+
+    const NaoFileReader* _reader;
+    int _queueDepth;
+    int _inFlight = 0;
+
+    QVector<Request> _queued;
+
+    // thread pool backend
+
+    QThreadPool* _pool = nullptr;
+    QMutex _lock;
+    QWaitCondition _done;
+    QVector<Completion> _completed;
+
+    // io_uring backend
+
+    struct Ring;
+    Ring* _ring = nullptr;
+
+    int _reap(QVector<Completion>& out, int min);
+
+    friend class NaoAsyncRead;
+};
+
+#endif // NAOASYNCIO_H
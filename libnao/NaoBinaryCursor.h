@@ -0,0 +1,123 @@
+#ifndef NAOBINARYCURSOR_H
+#define NAOBINARYCURSOR_H
+
+#include "libnao_global.h"
+#include "NaoEndian.h"
+
+#include <QByteArray>
+#include <QString>
+
+// Lightweight, non-owning cursor over data that's already in memory.
+// Same read vocabulary as NaoFileReader, but no device, no QObject and no allocations.
+// The data has to outlive the cursor.
+
+class NaoBinaryCursor {
+    public:
+    NaoBinaryCursor(const uchar* data, qint64 size) :
+        _data(data),
+        _size(size) { }
+
+    NaoBinaryCursor(const char* data, qint64 size) :
+        _data(reinterpret_cast<const uchar*>(data)),
+        _size(size) { }
+
+    NaoBinaryCursor(const QByteArray& data) :
+        _data(reinterpret_cast<const uchar*>(data.constData())),
+        _size(data.size()) { }
+
+    const uchar* data() const { return _data; }
+    qint64 size() const { return _size; }
+    qint64 pos() const { return _pos; }
+    qint64 remaining() const { return _size - _pos; }
+    bool atEnd() const { return _pos >= _size; }
+
+    bool seek(qint64 p) {
+        if (p < 0 || p > _size) {
+            return false;
+        }
+
+        _pos = p;
+
+        return true;
+    }
+
+    bool seekRel(qint64 p) {
+        return seek(_pos + p);
+    }
+
+    // pointer to n bytes at offset, dies if they're not all there
+    const uchar* at(qint64 offset, qint64 n) const {
+        if (offset < 0 || n < 0 || offset > _size - n) {
+            qFatal("NaoBinaryCursor: read of %lld bytes at %lld out of bounds (size %lld)", n, offset, _size);
+        }
+
+        return _data + offset;
+    }
+
+    // same as at(), but at the current position and advancing past the bytes
+    const uchar* take(qint64 n) {
+        const uchar* p = at(_pos, n);
+        _pos += n;
+
+        return p;
+    }
+
+    QByteArray read(qint64 n) {
+        return QByteArray::fromRawData(reinterpret_cast<const char*>(take(n)), n);
+    }
+
+    template <typename T, NaoEndian E>
+    T read() {
+        return NaoBytes::load<T, E>(take(sizeof(T)));
+    }
+
+    template <typename T, NaoEndian E>
+    T readAt(qint64 offset) const {
+        return NaoBytes::load<T, E>(at(offset, sizeof(T)));
+    }
+
+    quint8 readUChar() { return read<quint8, NaoEndian::Little>(); }
+    qint8 readChar() { return read<qint8, NaoEndian::Little>(); }
+    quint16 readUShortLE() { return read<quint16, NaoEndian::Little>(); }
+    quint16 readUShortBE() { return read<quint16, NaoEndian::Big>(); }
+    qint16 readShortLE() { return read<qint16, NaoEndian::Little>(); }
+    qint16 readShortBE() { return read<qint16, NaoEndian::Big>(); }
+    quint32 readUIntLE() { return read<quint32, NaoEndian::Little>(); }
+    quint32 readUIntBE() { return read<quint32, NaoEndian::Big>(); }
+    qint32 readIntLE() { return read<qint32, NaoEndian::Little>(); }
+    qint32 readIntBE() { return read<qint32, NaoEndian::Big>(); }
+    quint64 readULongLE() { return read<quint64, NaoEndian::Little>(); }
+    quint64 readULongBE() { return read<quint64, NaoEndian::Big>(); }
+    qint64 readLongLE() { return read<qint64, NaoEndian::Little>(); }
+    qint64 readLongBE() { return read<qint64, NaoEndian::Big>(); }
+    float readFloatLE() { return read<float, NaoEndian::Little>(); }
+    float readFloatBE() { return read<float, NaoEndian::Big>(); }
+    double readDoubleLE() { return read<double, NaoEndian::Little>(); }
+    double readDoubleBE() { return read<double, NaoEndian::Big>(); }
+
+    // null-terminated string at offset as a view (without the null), runs to the end if unterminated
+    QByteArray stringAt(qint64 offset) const {
+        const char* start = reinterpret_cast<const char*>(at(offset, 0));
+        const char* end = static_cast<const char*>(memchr(start, '\0', _size - offset));
+
+        return QByteArray::fromRawData(start, end ? (end - start) : (_size - offset));
+    }
+
+    QByteArray readStringView() {
+        QByteArray r = stringAt(_pos);
+        _pos = qMin(_size, _pos + r.size() + 1);
+
+        return r;
+    }
+
+    QString readString() {
+        return QString::fromLatin1(readStringView());
+    }
+
+    private:
+    const uchar* _data;
+    qint64 _size;
+    qint64 _pos = 0;
+};
+
+#endif // NAOBINARYCURSOR_H
@@ -0,0 +1,745 @@
+#include "NaoCRILAYLA.h"
+#include "NaoEndian.h"
+
+#include <QThreadPool>
+#include <QRunnable>
+#include <QThread>
+
+#include <algorithm>
+#include <array>
+#include <climits>
+
+namespace {
+
+    // the bitstream is consumed MSB first, starting at the last byte and moving towards the front.
+    // bits are kept left-aligned in a 64-bit word that's topped up 8 bytes at a time: loading the 8 bytes
+    // ending at pos as little endian puts the byte at pos on top, which is exactly the order we want them in
+
+    class ReverseBitReader {
+        public:
+        ReverseBitReader(const uchar* data, qint64 pos) :
+            _data(data),
+            _pos(pos) { }
+
+        // after this there are at least 56 bits available, unless we ran out of input
+        inline void refill() {
+            if (_pos >= 7) {
+                _bits |= NaoBytes::load<quint64, NaoEndian::Little>(_data + _pos - 7) >> _count;
+                _pos -= (63 - _count) >> 3;
+                _count |= 56;
+            } else {
+
+                // the first few bytes of the input, go one at a time so we don't read in front of it
+
+                while (_count <= 56 && _pos >= 0) {
+                    _bits |= static_cast<quint64>(_data[_pos--]) << (56 - _count);
+                    _count += 8;
+                }
+            }
+        }
+
+        // past the end the buffer is just zeroes, so check exhausted() once something has been consumed
+        inline quint32 peek(int n) const {
+            return static_cast<quint32>(_bits >> (64 - n));
+        }
+
+        inline void consume(int n) {
+            _bits <<= n;
+            _count -= n;
+        }
+
+        inline quint32 take(int n) {
+            quint32 v = peek(n);
+            consume(n);
+
+            return v;
+        }
+
+        inline int available() const {
+            return _count;
+        }
+
+        inline bool exhausted() const {
+            return _count < 0;
+        }
+
+        private:
+        const uchar* _data;
+        qint64 _pos;            // next byte to load
+        quint64 _bits = 0;
+        int _count = 0;         // valid bits at the top of _bits
+    };
+
+    // match lengths start with 2, 3 and 5 bit fields, each one all ones carries on into the next,
+    // so peeking 10 bits resolves the whole thing in one lookup: the length so far, how many bits
+    // it used, and whether 8-bit groups follow
+
+    struct LengthCode {
+        quint8 length;
+        quint8 bits;
+        bool more;
+    };
+
+    constexpr std::array<LengthCode, 1024> makeLengthTable() {
+        std::array<LengthCode, 1024> table {};
+
+        for (quint32 i = 0; i < 1024; ++i) {
+            quint32 first = i >> 8;
+            quint32 second = (i >> 5) & 7;
+            quint32 third = i & 31;
+
+            if (first != 3) {
+                table[i] = { static_cast<quint8>(first), 2, false };
+            } else if (second != 7) {
+                table[i] = { static_cast<quint8>(3 + second), 5, false };
+            } else if (third != 31) {
+                table[i] = { static_cast<quint8>(10 + third), 10, false };
+            } else {
+                table[i] = { 41, 10, true };
+            }
+        }
+
+        return table;
+    }
+
+    constexpr std::array<LengthCode, 1024> lengthTable = makeLengthTable();
+
+    // copy a match of length bytes ending at top from distance bytes above it, going down like the format does.
+    // when the match overlaps itself the source repeats with a period of distance, so any multiple of the
+    // distance that stays inside what's already there is just as good a source, and that doubles every step
+    inline void copyMatch(uchar* top, qint64 distance, qint64 length, const uchar* limit) {
+        if (distance >= 8 && (top - limit) - length - 7 >= 0) {
+
+            // 8 bytes at a time, may overshoot by up to 7 bytes below the match, but those haven't been written yet
+
+            for (qint64 done = 0; done < length; done += 8) {
+                memcpy(top - done - 7, top - done - 7 + distance, 8);
+            }
+
+            return;
+        }
+
+        qint64 done = 0;
+
+        while (done < length) {
+            qint64 step = ((done + distance) / distance) * distance;
+            qint64 n = qMin(step, length - done);
+
+            memcpy(top - done - n + 1, top - done - n + 1 + step, static_cast<size_t>(n));
+            done += n;
+        }
+    }
+
+    // output straight into one buffer that holds everything
+    class LinearOutput {
+        public:
+        LinearOutput(uchar* out, qint64 size) :
+            _last(out + 0xFF + size),
+            _stop(out + 0x100),
+            _dst(_last) { }
+
+        inline bool done() const {
+            return _dst < _stop;
+        }
+
+        inline bool literal(uchar b) {
+            *_dst-- = b;
+
+            return true;
+        }
+
+        inline bool match(qint64 distance, qint64 length) {
+
+            // corrupt data could point past what we've written or run into the prefix
+
+            if (distance > _last - _dst || length > _dst - _stop + 1) {
+                return false;
+            }
+
+            copyMatch(_dst, distance, length, _stop);
+            _dst -= length;
+
+            return true;
+        }
+
+        inline bool finish() {
+            return true;
+        }
+
+        private:
+        uchar* const _last;
+        uchar* const _stop;
+        uchar* _dst;
+    };
+
+    // output through a window, everything in it is handed to the sink whenever it fills up. matches reach at most
+    // maxDistance bytes back (up, really), so that much of what was already flushed is kept above the window.
+    // offsets are positions in the complete output, the window covers [_base, _base + window + maxDistance)
+
+    class WindowedOutput {
+        public:
+        WindowedOutput(uchar* buffer, qint64 window, qint64 size, const NaoCRILAYLA::Sink& sink) :
+            _buffer(buffer),
+            _window(window),
+            _top(0x100 + size),
+            _base(_top - window - NaoCRILAYLA::maxDistance),
+            _dst(_top - 1),
+            _pending(_top),
+            _sink(sink) { }
+
+        inline bool done() const {
+            return _dst < 0x100;
+        }
+
+        inline bool literal(uchar b) {
+            if (_dst < _base && !_slide()) {
+                return false;
+            }
+
+            _buffer[_dst-- - _base] = b;
+
+            return true;
+        }
+
+        inline bool match(qint64 distance, qint64 length) {
+            if (distance > _top - 1 - _dst || length > _dst - 0x100 + 1) {
+                return false;
+            }
+
+            // a match may be longer than the window, it's fine to copy it in pieces since
+            // each piece only needs what's directly above it
+
+            while (length > 0) {
+                if (_dst < _base && !_slide()) {
+                    return false;
+                }
+
+                qint64 n = qMin(length, _dst - _base + 1);
+
+                copyMatch(_buffer + (_dst - _base), distance, n, _buffer);
+                _dst -= n;
+                length -= n;
+            }
+
+            return true;
+        }
+
+        inline bool finish() {
+            return _flush(_dst + 1);
+        }
+
+        private:
+
+        // the window is full: flush it and move its bottom to the top as the history for the next one
+        bool _slide() {
+            if (!_flush(_base)) {
+                return false;
+            }
+
+            memmove(_buffer + _window, _buffer, NaoCRILAYLA::maxDistance);
+            _base -= _window;
+
+            return true;
+        }
+
+        bool _flush(qint64 from) {
+            bool ok = (from >= _pending) || _sink(from, _buffer + (from - _base), _pending - from);
+            _pending = from;
+
+            return ok;
+        }
+
+        uchar* const _buffer;
+        const qint64 _window;
+        const qint64 _top;
+        qint64 _base;
+        qint64 _dst;        // next byte to write
+        qint64 _pending;    // everything from here up has been flushed
+        const NaoCRILAYLA::Sink& _sink;
+    };
+
+    // decode the bitstream in data, the 0x100 byte prefix is left to the caller
+    template <typename Output>
+    bool decode(const uchar* data, qint64 dataSize, Output& out) {
+        ReverseBitReader bits(data, dataSize - 0x101);
+
+        while (!out.done()) {
+
+            // the longest token without a length extension is 1 + 13 + 10 bits
+
+            if (bits.available() < 24) {
+                bits.refill();
+            }
+
+            bool ok;
+
+            if (bits.take(1) == 0) {
+                ok = out.literal(static_cast<uchar>(bits.take(8)));
+            } else {
+                qint64 distance = bits.take(13) + 3;
+
+                const LengthCode& code = lengthTable[bits.peek(10)];
+                bits.consume(code.bits);
+
+                qint64 length = 3 + code.length;
+
+                if (code.more) {
+                    quint32 group;
+
+                    do {
+                        if (bits.available() < 8) {
+                            bits.refill();
+                        }
+
+                        group = bits.take(8);
+                        length += group;
+                    } while (group == 0xFF && !bits.exhausted());
+                }
+
+                ok = !bits.exhausted() && out.match(distance, length);
+            }
+
+            if (!ok || bits.exhausted()) {
+                return false;
+            }
+        }
+
+        return out.finish();
+    }
+
+    // encoding is LZ77 over the tail of the data reversed, since that's the order the decoder produces it in
+
+    const qint64 literalCost = 9;
+
+    inline qint64 lengthCost(qint64 length) {
+        qint64 v = length - 3;
+
+        if (v < 3) {
+            return 2;
+        } else if (v < 10) {
+            return 5;
+        } else if (v < 41) {
+            return 10;
+        }
+
+        return 18 + 8 * ((v - 41) / 255);
+    }
+
+    inline qint64 matchCost(qint64 length) {
+        return 1 + 13 + lengthCost(length);
+    }
+
+    // bits go out MSB first, the bytes get reversed once everything is written
+    class BitWriter {
+        public:
+
+        // nothing costs more than 9 bits per input byte, so this never has to grow
+        explicit BitWriter(qint64 size) :
+            _stream(static_cast<int>(size + size / 8 + 8), Qt::Uninitialized),
+            _dst(reinterpret_cast<uchar*>(_stream.data())) { }
+
+        inline void put(quint32 val, int bits) {
+            _bits = (_bits << bits) | val;
+            _count += bits;
+
+            while (_count >= 8) {
+                _count -= 8;
+                *_dst++ = static_cast<uchar>(_bits >> _count);
+            }
+        }
+
+        inline void literal(uchar b) {
+            put(b, 9);
+        }
+
+        inline void match(qint64 distance, qint64 length) {
+            put(0x2000 | static_cast<quint32>(distance - 3), 14);
+
+            // 2, 3 and 5 bits, every field that's all ones continues into the next one, then 8-bit groups
+
+            qint64 v = length - 3;
+
+            for (int bits : { 2, 3, 5 }) {
+                quint32 max = (1U << bits) - 1;
+
+                if (v < max) {
+                    put(static_cast<quint32>(v), bits);
+                    return;
+                }
+
+                put(max, bits);
+                v -= max;
+            }
+
+            for (; v >= 0xFF; v -= 0xFF) {
+                put(0xFF, 8);
+            }
+
+            put(static_cast<quint32>(v), 8);
+        }
+
+        // the finished bitstream, in the order it's stored in
+        QByteArray finish() {
+            if (_count > 0) {
+                put(0, 8 - _count);
+            }
+
+            int size = static_cast<int>(_dst - reinterpret_cast<uchar*>(_stream.data()));
+            _stream.truncate(size);
+            std::reverse(_stream.begin(), _stream.end());
+
+            return _stream;
+        }
+
+        private:
+        QByteArray _stream;
+        uchar* _dst;
+        quint64 _bits = 0;
+        int _count = 0;
+    };
+
+    // hash chains: every position links to the previous one starting with the same 3 bytes
+    class MatchFinder {
+        public:
+        MatchFinder(const uchar* data, qint64 size, int depth, qint64 niceLength) :
+            _data(data),
+            _size(size),
+            _depth(depth),
+            _niceLength(niceLength),
+            _head(1 << hashBits, -1),
+            _prev(static_cast<int>(size)) { }
+
+        inline void insert(qint64 i) {
+            if (i + 3 <= _size) {
+                quint32 h = _hash(i);
+
+                _prev[static_cast<int>(i)] = _head[h];
+                _head[h] = static_cast<qint32>(i);
+            }
+        }
+
+        // longest match for i among the positions inserted so far, 0 if there's none of at least 3 bytes
+        qint64 find(qint64 i, qint64& distance) const {
+            if (i + 3 > _size) {
+                return 0;
+            }
+
+            const qint64 limit = _size - i;
+            qint64 best = 2;
+            int depth = _depth;
+
+            for (qint64 c = _head[_hash(i)]; c >= 0 && i - c <= NaoCRILAYLA::maxDistance && depth > 0;
+                 c = _prev[static_cast<int>(c)]) {
+
+                // the two positions right before can't be used, matches start 3 back
+
+                if (i - c < 3) {
+                    continue;
+                }
+
+                --depth;
+
+                if (_data[c + best] != _data[i + best]) {
+                    continue;
+                }
+
+                qint64 length = _matchLength(_data + c, _data + i, limit);
+
+                if (length > best) {
+                    best = length;
+                    distance = i - c;
+
+                    if (length >= _niceLength || length == limit) {
+                        break;
+                    }
+                }
+            }
+
+            return (best >= 3) ? best : 0;
+        }
+
+        private:
+        static const int hashBits = 15;
+
+        inline quint32 _hash(qint64 i) const {
+            quint32 v = static_cast<quint32>(_data[i]) << 16 | static_cast<quint32>(_data[i + 1]) << 8 | _data[i + 2];
+
+            return (v * 2654435761U) >> (32 - hashBits);
+        }
+
+        static inline qint64 _matchLength(const uchar* a, const uchar* b, qint64 limit) {
+            qint64 n = 0;
+
+            while (n + 8 <= limit && memcmp(a + n, b + n, 8) == 0) {
+                n += 8;
+            }
+
+            while (n < limit && a[n] == b[n]) {
+                ++n;
+            }
+
+            return n;
+        }
+
+        const uchar* _data;
+        const qint64 _size;
+        const int _depth;
+        const qint64 _niceLength;
+        QVector<qint32> _head;
+        QVector<qint32> _prev;
+    };
+
+    // take the longest match wherever there is one
+    void encodeGreedy(const uchar* data, qint64 size, BitWriter& out) {
+        MatchFinder finder(data, size, 16, 258);
+        qint64 i = 0;
+
+        while (i < size) {
+            qint64 distance = 0;
+            qint64 length = finder.find(i, distance);
+
+            if (length == 0) {
+                out.literal(data[i]);
+                finder.insert(i++);
+                continue;
+            }
+
+            out.match(distance, length);
+
+            for (qint64 end = i + length; i < end; ++i) {
+                finder.insert(i);
+            }
+        }
+    }
+
+    // every match costs the same no matter the distance, so the longest match at each position tells us every
+    // token that can start there. find the cheapest way through all of them, front to back
+    void encodeOptimal(const uchar* data, qint64 size, BitWriter& out) {
+        const qint64 niceLength = 256;
+
+        struct Step {
+            qint64 price;
+            qint32 length;      // of the token that ends here, 1 for a literal
+            qint32 distance;
+        };
+
+        MatchFinder finder(data, size, 128, niceLength);
+        QVector<Step> steps(static_cast<int>(size + 1), { LLONG_MAX, 0, 0 });
+        steps[0].price = 0;
+
+        // positions inside a long match that was taken as a whole aren't searched, that's where all the time would go otherwise
+
+        qint64 skipUntil = 0;
+
+        for (qint64 i = 0; i < size; ++i) {
+            const qint64 price = steps[static_cast<int>(i)].price;
+
+            Step& next = steps[static_cast<int>(i + 1)];
+
+            if (price + literalCost < next.price) {
+                next = { price + literalCost, 1, 0 };
+            }
+
+            if (i < skipUntil) {
+                finder.insert(i);
+                continue;
+            }
+
+            qint64 distance = 0;
+            qint64 longest = finder.find(i, distance);
+            finder.insert(i);
+
+            qint64 from = (longest >= niceLength) ? longest : 3;
+
+            if (longest >= niceLength) {
+                skipUntil = i + longest;
+            }
+
+            for (qint64 length = from; length <= longest; ++length) {
+                Step& to = steps[static_cast<int>(i + length)];
+                qint64 cost = price + matchCost(length);
+
+                if (cost < to.price) {
+                    to = { cost, static_cast<qint32>(length), static_cast<qint32>(distance) };
+                }
+            }
+        }
+
+        // walk back from the end to find the path, then write it out front to back
+
+        QVector<qint32> path;
+
+        for (qint64 i = size; i > 0; i -= steps[static_cast<int>(i)].length) {
+            path.append(static_cast<qint32>(i));
+        }
+
+        for (int p = path.size() - 1; p >= 0; --p) {
+            const Step& step = steps[path.at(p)];
+
+            if (step.length == 1) {
+                out.literal(data[path.at(p) - 1]);
+            } else {
+                out.match(step.distance, step.length);
+            }
+        }
+    }
+
+    class CompressJob : public QRunnable {
+        public:
+        CompressJob(const QVector<QByteArray>& data, QByteArray* results, QAtomicInt* next, NaoCRILAYLA::Mode mode) :
+            _data(data),
+            _results(results),
+            _next(next),
+            _mode(mode) { }
+
+        void run() override {
+            for (int i = _next->fetchAndAddRelaxed(1); i < _data.size(); i = _next->fetchAndAddRelaxed(1)) {
+                _results[i] = NaoCRILAYLA::compress(_data.at(i), _mode);
+            }
+        }
+
+        private:
+        const QVector<QByteArray>& _data;
+        QByteArray* _results;
+        QAtomicInt* _next;
+        NaoCRILAYLA::Mode _mode;
+    };
+}
+
+namespace NaoCRILAYLA {
+    qint64 decompressedSize(const uchar* data, qint64 size) {
+        if (size < 0x110 || memcmp(data, "CRILAYLA", 8) != 0) {
+            return -1;
+        }
+
+        quint32 uncompressed = NaoBytes::load<quint32, NaoEndian::Little>(data + 8);
+        quint32 headerOffset = NaoBytes::load<quint32, NaoEndian::Little>(data + 12);
+
+        if (static_cast<qint64>(headerOffset) + 0x110 > size) {
+            return -1;
+        }
+
+        return static_cast<qint64>(uncompressed) + 0x100;
+    }
+
+    bool decompress(const uchar* data, qint64 size, uchar* out, qint64 capacity) {
+        qint64 outSize = decompressedSize(data, size);
+
+        if (outSize < 0 || capacity < outSize) {
+            return false;
+        }
+
+        quint32 headerOffset = NaoBytes::load<quint32, NaoEndian::Little>(data + 12);
+
+        memcpy(out, data + headerOffset + 0x10, 0x100);
+
+        LinearOutput output(out, outSize - 0x100);
+
+        return decode(data, size, output);
+    }
+
+    bool decompress(const uchar* data, qint64 size, qint64 window, const Sink& sink) {
+        qint64 outSize = decompressedSize(data, size);
+
+        if (outSize < 0) {
+            return false;
+        }
+
+        quint32 headerOffset = NaoBytes::load<quint32, NaoEndian::Little>(data + 12);
+
+        window = qMax<qint64>(window, 0x1000);
+
+        // no point in a window bigger than the whole thing
+
+        window = qMin(window, qMax<qint64>(outSize - 0x100, 1));
+
+        QByteArray buffer(static_cast<int>(window + maxDistance), Qt::Uninitialized);
+        WindowedOutput output(reinterpret_cast<uchar*>(buffer.data()), window, outSize - 0x100, sink);
+
+        return decode(data, size, output) && sink(0, data + headerOffset + 0x10, 0x100);
+    }
+
+    QByteArray decompress(const QByteArray& data) {
+        const uchar* in = reinterpret_cast<const uchar*>(data.constData());
+        qint64 size = decompressedSize(in, data.size());
+
+        if (size < 0 || size > INT_MAX) {
+            return QByteArray();
+        }
+
+        // every byte gets written, so don't bother clearing it
+
+        QByteArray result(static_cast<int>(size), Qt::Uninitialized);
+
+        if (!decompress(in, data.size(), reinterpret_cast<uchar*>(result.data()), size)) {
+            return QByteArray();
+        }
+
+        return result;
+    }
+
+    QByteArray compress(const QByteArray& data, Mode mode) {
+        const qint64 size = data.size();
+
+        if (size < 0x100) {
+            return QByteArray();
+        }
+
+        // the first 0x100 bytes are stored as they are, the rest is encoded in the order it's decoded in: back to front
+
+        const uchar* in = reinterpret_cast<const uchar*>(data.constData());
+        const qint64 n = size - 0x100;
+
+        QByteArray reversed(static_cast<int>(n), Qt::Uninitialized);
+        std::reverse_copy(in + 0x100, in + size, reinterpret_cast<uchar*>(reversed.data()));
+
+        BitWriter bits(n);
+
+        if (mode == Optimal) {
+            encodeOptimal(reinterpret_cast<const uchar*>(reversed.constData()), n, bits);
+        } else {
+            encodeGreedy(reinterpret_cast<const uchar*>(reversed.constData()), n, bits);
+        }
+
+        QByteArray stream = bits.finish();
+        QByteArray result(0x10, Qt::Uninitialized);
+
+        memcpy(result.data(), "CRILAYLA", 8);
+        NaoBytes::store<quint32, NaoEndian::Little>(static_cast<quint32>(n), result.data() + 8);
+        NaoBytes::store<quint32, NaoEndian::Little>(static_cast<quint32>(stream.size()), result.data() + 12);
+
+        result.append(stream);
+        result.append(data.constData(), 0x100);
+
+        return result;
+    }
+
+    QVector<QByteArray> compress(const QVector<QByteArray>& data, Mode mode, int threads) {
+        QVector<QByteArray> results(data.size());
+
+        if (threads <= 0) {
+            threads = QThread::idealThreadCount();
+        }
+
+        threads = qBound(1, threads, qMax(data.size(), 1));
+
+        // entries are handed out one at a time, so a few big ones don't leave the other threads idle
+
+        QAtomicInt next(0);
+
+        if (threads == 1) {
+            CompressJob(data, results.data(), &next, mode).run();
+        } else {
+            QThreadPool pool;
+            pool.setMaxThreadCount(threads);
+
+            for (int t = 0; t < threads; ++t) {
+                pool.start(new CompressJob(data, results.data(), &next, mode));
+            }
+
+            pool.waitForDone();
+        }
+
+        return results;
+    }
+}
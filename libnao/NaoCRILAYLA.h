@@ -0,0 +1,54 @@
+#ifndef NAOCRILAYLA_H
+#define NAOCRILAYLA_H
+
+#include "libnao_global.h"
+
+#include <QByteArray>
+#include <QVector>
+
+#include <functional>
+
+// CRILAYLA, the LZ77 variant CRIWare compresses CPK entries with.
+// A 0x10 byte header ("CRILAYLA", LE uint size, LE uint bitstream size), the bitstream, then the first 0x100 bytes
+// uncompressed. The bitstream is read back to front and decodes the rest of the data back to front as well.
+
+namespace NaoCRILAYLA {
+
+    // size of what the blob in data decompresses to (prefix included), -1 if the header isn't valid.
+    // only reads the 0x10 byte header, size is still that of the whole blob
+    LIBNAO_API qint64 decompressedSize(const uchar* data, qint64 size);
+
+    // decompress into out, which has to hold at least decompressedSize() bytes. doesn't allocate anything,
+    // so out can be a reused buffer or a mapped output file. returns false if the blob is corrupt,
+    // in which case out holds garbage
+    LIBNAO_API bool decompress(const uchar* data, qint64 size, uchar* out, qint64 capacity);
+
+    // decompress a complete CRILAYLA blob, returns an empty array if it isn't one or it's corrupt
+    LIBNAO_API QByteArray decompress(const QByteArray& data);
+
+    // furthest back a match can reach
+    constexpr qint64 maxDistance = 0x2002;
+
+    // receives a decoded block of n bytes that goes at offset in the output, return false to stop
+    using Sink = std::function<bool(qint64 offset, const uchar* data, qint64 n)>;
+
+    // decompress without ever holding more than window (+ maxDistance) bytes of the output. blocks are handed to sink
+    // in the order they're decoded: back to front, ending with the prefix at offset 0, so sink has to be able to
+    // write anywhere (positioned writes into a file of the right size, a mapping, ...).
+    // if it fails part of the output may already be written
+    LIBNAO_API bool decompress(const uchar* data, qint64 size, qint64 window, const Sink& sink);
+
+    enum Mode {
+        Greedy,     // longest match at every position
+        Optimal     // cheapest encoding overall, a lot slower but smaller
+    };
+
+    // compress data into a blob decompress() accepts, data needs at least the 0x100 byte prefix (empty otherwise).
+    // data that doesn't compress comes out bigger than it went in, CPK stores those as they are instead
+    LIBNAO_API QByteArray compress(const QByteArray& data, Mode mode = Greedy);
+
+    // compress independent entries on threads threads (0 for one per core), results are in the same order
+    LIBNAO_API QVector<QByteArray> compress(const QVector<QByteArray>& data, Mode mode = Greedy, int threads = 0);
+}
+
+#endif // NAOCRILAYLA_H
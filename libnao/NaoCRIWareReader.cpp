@@ -1,7 +1,47 @@
 #include "NaoCRIWareReader.h"
+#include "NaoBinaryCursor.h"
+#include "NaoUTFSchema.h"
+#include "NaoIndexCache.h"
+#include "NaoAsyncIO.h"
+
+#include <QFileDevice>
+#include <QThreadPool>
+#include <QRunnable>
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QRegularExpression>
+
+#if QT_VERSION < QT_VERSION_CHECK(5, 12, 0)
+#include <QRegExp>
+#endif
+
+#include <algorithm>
+#include <climits>
+
+// entries that decompress to more than this are streamed if the output allows it, or don't use the batch's scratch buffers otherwise
+static constexpr qint64 scratchLimit = 0x4000000;
+
+static bool openForWriting(QIODevice* device) {
+    if (!device->isWritable()) {
+        device->open(QIODevice::WriteOnly);
+    }
+
+    return device->isWritable();
+}
+
+// a job for extractFiles()
+class NaoBatchJob : public QRunnable {
+    public:
+    NaoBatchJob(const std::function<void()>& job) : _job(job) { }
+
+    void run() override {
+        _job();
+    }
 
-#include <QTextCodec>
-#include <windows.h>
+    private:
+    std::function<void()> _job;
+};
 
 NaoCRIWareReader::NaoCRIWareReader(QString infile) : NaoFileReader(infile) {
     startup();
@@ -11,6 +51,108 @@ NaoCRIWareReader::NaoCRIWareReader(QIODevice *device) : NaoFileReader(device) {
     startup();
 }
 
+NaoCRIWareReader::NaoCRIWareReader(QString infile, const OpenOptions& options) : NaoFileReader(infile), _options(options) {
+    startup();
+}
+
+NaoCRIWareReader::NaoCRIWareReader(QIODevice* device, const OpenOptions& options) : NaoFileReader(device), _options(options) {
+    startup();
+}
+
+// one of the OpenOptions filters, remembering what it said about every string it has seen
+class NaoNameFilter {
+    public:
+    NaoNameFilter(const QString& filter, NaoCRIWareReader::OpenOptions::FilterSyntax syntax) :
+        _filter(filter),
+        _syntax(syntax) {
+
+        if (syntax == NaoCRIWareReader::OpenOptions::Glob) {
+
+            // wildcardToRegularExpression is only there since 5.12, QRegExp matches the same way
+
+#if QT_VERSION >= QT_VERSION_CHECK(5, 12, 0)
+            _regex = QRegularExpression(QRegularExpression::wildcardToRegularExpression(filter));
+#else
+            _wildcard = QRegExp(filter, Qt::CaseSensitive, QRegExp::Wildcard);
+#endif
+        } else if (syntax == NaoCRIWareReader::OpenOptions::RegExp) {
+            _regex = QRegularExpression(filter);
+        }
+    }
+
+    bool matches(const NaoCRIWareReader::UTFReader& utf, int column, quint32 row) {
+        if (_filter.isEmpty()) {
+            return true;
+        }
+
+        // cells with the same key hold the same string, so each one is only decoded once
+
+        const quint32 key = utf.stringKeyAt(column, row);
+        QHash<quint32, bool>::const_iterator it = _seen.constFind(key);
+
+        if (it != _seen.constEnd()) {
+            return it.value();
+        }
+
+        const bool match = matches(utf.stringAt(column, row));
+        _seen.insert(key, match);
+
+        return match;
+    }
+
+    bool matches(const QString& name) const {
+        if (_filter.isEmpty()) {
+            return true;
+        }
+
+#if QT_VERSION < QT_VERSION_CHECK(5, 12, 0)
+        if (_syntax == NaoCRIWareReader::OpenOptions::Glob) {
+            return _wildcard.exactMatch(name);
+        }
+#endif
+
+        return (_syntax == NaoCRIWareReader::OpenOptions::Prefix) ? name.startsWith(_filter) : _regex.match(name).hasMatch();
+    }
+
+    private:
+    QString _filter;
+    NaoCRIWareReader::OpenOptions::FilterSyntax _syntax;
+    QRegularExpression _regex;
+
+#if QT_VERSION < QT_VERSION_CHECK(5, 12, 0)
+    QRegExp _wildcard;
+#endif
+
+    QHash<quint32, bool> _seen;
+};
+
+// the TOC and ETOC columns we read, in the layout every CPK we've seen uses
+
+typedef NaoCRIWareReader::EmbeddedFile EmbeddedFile;
+
+static constexpr auto tocSchema = NaoUTF::schema<EmbeddedFile>(
+    NaoUTF::field<NaoUTF::UTF::String>("FileName", &EmbeddedFile::name),
+    NaoUTF::field<NaoUTF::UTF::String>("DirName", &EmbeddedFile::path),
+    NaoUTF::field<NaoUTF::UTF::String>("UserString", &EmbeddedFile::userString),
+    NaoUTF::field<NaoUTF::UTF::uLong>("FileOffset", &EmbeddedFile::offset),
+    NaoUTF::field<NaoUTF::UTF::uInt>("FileSize", &EmbeddedFile::size),
+    NaoUTF::field<NaoUTF::UTF::uInt>("ExtractSize", &EmbeddedFile::extractedSize),
+    NaoUTF::field<NaoUTF::UTF::uInt>("ID", &EmbeddedFile::id));
+
+struct EtocRow {
+    QString localDir;
+    quint64 updateDateTime;
+};
+
+static constexpr auto etocSchema = NaoUTF::schema<EtocRow>(
+    NaoUTF::field<NaoUTF::UTF::String>("LocalDir", &EtocRow::localDir),
+    NaoUTF::field<NaoUTF::UTF::uLong>("UpdateDateTime", &EtocRow::updateDateTime));
+
+NaoCRIWareReader::~NaoCRIWareReader() {
+    delete _cpkUTF;
+    delete _gtocUTF;
+}
+
 void NaoCRIWareReader::startup() {
     if (_fourCC != "CPK " && _fourCC != "CRID") {
         qFatal("Invalid CRIWare fourCC found");
@@ -19,17 +161,52 @@ void NaoCRIWareReader::startup() {
     // CPK archives start with "CPK ", USM files with CRID
     _isPak = (_fourCC == "CPK ");
 
+    // nothing to parse if the archive is indexed already. a filtered open has only part of it, so it's not cached
+
+    NaoIndexCache* cache = _options.readsEverything() ? _options.cache : nullptr;
+
+    if (cache) {
+        beginPhase("cache");
+
+        const bool cached = cache->load(*this);
+
+        endPhase();
+
+        if (cached) {
+            return;
+        }
+    }
+
     if(_isPak) {
+        beginPhase("header");
+
         seekRel(16); // skip fourCC and information on the @UTF that follows (the chunk itself contains the same data)
 
         _cpkOffset = pos();
-        _cpkUTF = new UTFReader(readNextUTF());
 
-        if (_cpkUTF->getFieldData(0, "TocOffset").isValid()) {
+        // only a handful of its fields are ever read, so don't decode the whole thing
+
+        _cpkUTF = new UTFReader(readNextUTF(), UTFReader::Lazy);
+
+        endPhase();
+
+        // look the header fields up once
+
+        const int tocOffsetField = _cpkUTF->column("TocOffset");
+        const int contentOffsetField = _cpkUTF->column("ContentOffset");
+        const int etocOffsetField = _cpkUTF->column("EtocOffset");
+        const int itocOffsetField = _cpkUTF->column("ItocOffset");
+        const int gtocOffsetField = _cpkUTF->column("GtocOffset");
+
+        // the TOC row of every entry, if they aren't all read
+
+        QVector<quint32> tocRows;
+
+        if (_cpkUTF->hasValue(tocOffsetField)) {
 
             // we have a TOC field
 
-            quint64 tocOffset = _cpkUTF->getFieldData(0, "TocOffset").toULongLong();
+            quint64 tocOffset = _cpkUTF->u64At(tocOffsetField, 0);
             quint64 offset = 0;
 
             // clamp to 2048
@@ -37,17 +214,19 @@ void NaoCRIWareReader::startup() {
                 tocOffset = 0x800U;
             }
 
-            if (!_cpkUTF->getFieldData(0, "ContentOffset").isValid()) {
+            if (!_cpkUTF->hasValue(contentOffsetField)) {
                 offset = tocOffset;
-            } else if (_cpkUTF->getFieldData(0, "ContentOffset").toULongLong() < tocOffset) {
-                offset = _cpkUTF->getFieldData(0, "ContentOffset").toULongLong();
+            } else if (_cpkUTF->u64At(contentOffsetField, 0) < tocOffset) {
+                offset = _cpkUTF->u64At(contentOffsetField, 0);
             } else {
                 offset = tocOffset;
             }
 
-            seek(_cpkUTF->getFieldData(0, "TocOffset").toULongLong());
+            beginPhase("toc");
+
+            seek(_cpkUTF->u64At(tocOffsetField, 0));
 
-            if (read(4) != QByteArray("TOC ", 4)) {
+            if (readView(4) != QByteArray("TOC ", 4)) {
                 qFatal("Invalid TOC fourCC found");
             }
 
@@ -55,33 +234,37 @@ void NaoCRIWareReader::startup() {
 
             seekRel(12);
 
-            UTFReader* filesUTF = new UTFReader(readNextUTF());
+            // every cell is read exactly once, straight from the packet
 
-            for (quint16 i = 0; i < filesUTF->getRowCount(); i++) {
-                EmbeddedFile file;
+            UTFReader* filesUTF = new UTFReader(readNextUTF(), UTFReader::Lazy);
 
-                file.origin = "TOC ";
-                file.name = filesUTF->getFieldData(i, "FileName").toString();
-                file.path = filesUTF->getFieldData(i, "DirName").toString();
-                file.userString = filesUTF->getFieldData(i, "UserString").toString();
-                file.offset = filesUTF->getFieldData(i, "FileOffset").toLongLong();
-                file.extraOffset = offset;
-                file.size = filesUTF->getFieldData(i, "FileSize").toLongLong();
-                file.extractedSize = filesUTF->getFieldData(i, "ExtractSize").toLongLong();
-                file.id = filesUTF->getFieldData(i, "ID").toUInt();
+            if (_options.readsEverything()) {
 
-                files.push_back(file);
+                // straight into the file list, through the generic accessors if the columns aren't what we expect
+
+                files = tocSchema.decode(*filesUTF);
+
+                for (EmbeddedFile& file : files) {
+                    file.origin = "TOC ";
+                    file.extraOffset = offset;
+                }
+            } else {
+                _readFilteredTOC(*filesUTF, static_cast<qint64>(offset), tocRows);
             }
 
             delete filesUTF;
+
+            endPhase();
         }
 
-        // if we have an Etoc (Itoc and Gtoc omitted)
+        // if we have an Etoc, and want something from it. it has a row for every TOC row
+
+        if (_cpkUTF->hasValue(etocOffsetField) && (_options.columns & (OpenOptions::LocalDir | OpenOptions::UpdateDateTime))) {
+            beginPhase("etoc");
 
-        if (_cpkUTF->getFieldData(0, "EtocOffset").isValid()) {
-            seek(_cpkUTF->getFieldData(0, "EtocOffset").toULongLong());
+            seek(_cpkUTF->u64At(etocOffsetField, 0));
 
-            if (read(4) != QByteArray("ETOC", 4)) {
+            if (readView(4) != QByteArray("ETOC", 4)) {
                 qFatal("Invalid ETOC fourCC found");
             }
 
@@ -89,18 +272,96 @@ void NaoCRIWareReader::startup() {
 
             seekRel(12);
 
-            UTFReader* filesUTF = new UTFReader(readNextUTF());
+            UTFReader* filesUTF = new UTFReader(readNextUTF(), UTFReader::Lazy);
 
             // update the possibly cntained values
 
-            for (int i = 0; i < files.size(); i++) {
-                files[i].localDir = filesUTF->getFieldData(i, "LocalDir").toString();
-                files[i].updateDateTime = filesUTF->getFieldData(i, "UpdateDateTime").toULongLong();
+            if (_options.readsEverything()) {
+                const QVector<EtocRow> etoc = etocSchema.decode(*filesUTF);
+                const int rows = qMin(etoc.size(), files.size());
+
+                for (int i = 0; i < rows; i++) {
+                    files[i].localDir = etoc.at(i).localDir;
+                    files[i].updateDateTime = etoc.at(i).updateDateTime;
+                }
+            } else {
+
+                // only the rows of the entries we kept, and only what was asked for
+
+                const int localDir = (_options.columns & OpenOptions::LocalDir) ? filesUTF->column("LocalDir") : -1;
+                const int updateDateTime = (_options.columns & OpenOptions::UpdateDateTime) ? filesUTF->column("UpdateDateTime") : -1;
+
+                for (int i = 0; i < files.size(); i++) {
+                    const quint32 row = tocRows.at(i);
+
+                    if (row >= filesUTF->getRowCount()) {
+                        break;
+                    }
+
+                    if (localDir >= 0) {
+                        files[i].localDir = filesUTF->stringAt(localDir, row);
+                    }
+
+                    if (updateDateTime >= 0) {
+                        files[i].updateDateTime = filesUTF->u64At(updateDateTime, row);
+                    }
+                }
+            }
+
+            delete filesUTF;
+
+            endPhase();
+        }
+
+        // an ITOC has the files by ID only, without names. with a TOC it's the same files again,
+        // so it's only read when it's all there is
+
+        if (!_cpkUTF->hasValue(tocOffsetField) && _cpkUTF->hasValue(itocOffsetField)) {
+            beginPhase("itoc");
+
+            seek(_cpkUTF->u64At(itocOffsetField, 0));
+
+            if (readView(4) != QByteArray("ITOC", 4)) {
+                qFatal("Invalid ITOC fourCC found");
             }
 
+            seekRel(12);
+
+            UTFReader* filesUTF = new UTFReader(readNextUTF(), UTFReader::Lazy);
+
+            _readITOC(*filesUTF, _cpkUTF->s64At(contentOffsetField, 0), _cpkUTF->s64At(_cpkUTF->column("Align"), 0));
+
             delete filesUTF;
+
+            endPhase();
+        }
+
+        // the GTOC is kept as it is, it's read once and the packet may be a view
+
+        if (_cpkUTF->hasValue(gtocOffsetField)) {
+            beginPhase("gtoc");
+
+            _gtocOffset = _cpkUTF->u64At(gtocOffsetField, 0);
+
+            seek(_gtocOffset);
+
+            if (readView(4) != QByteArray("GTOC", 4)) {
+                qFatal("Invalid GTOC fourCC found");
+            }
+
+            seekRel(12);
+
+            _gtocUTF = new UTFReader(readNextUTF());
+            _readGTOC();
+
+            endPhase();
         }
+
+        _indexIds();
+        _indexPaths();
     } else {
+        beginPhase("header");
+
         // skip the foruCC and the following uint blockSize, since we'll be at the end of this block anyway when we finish reading
 
         seekRel(8);
@@ -125,7 +386,7 @@ void NaoCRIWareReader::startup() {
             qFatal("Invalid format");
         }
 
-        UTFReader* info = new UTFReader(readNextUTF());
+        UTFReader* info = new UTFReader(readNextUTF(), UTFReader::Lazy);
 
         // we have 1 row for each stream, plus one (the first) for the entire file
 
@@ -135,60 +396,82 @@ void NaoCRIWareReader::startup() {
 
         QMap<quint32, bool> ready;
 
+        const int filename = info->column("filename");
+        const int filesize = info->column("filesize");
+        const int stmid = info->column("stmid");
+        const int avbps = info->column("avbps");
+
         for (qint8 i = 1; i <= nStreams; i++) {
-            EmbeddedFile file;
+            EmbeddedFile file = EmbeddedFile();
 
-            file.name = info->getFieldData(i, "filename").toString();
-            file.size = info->getFieldData(i, "filesize").toLongLong();
+            file.name = info->stringAt(filename, i);
+            file.size = info->s64At(filesize, i);
             file.extractedSize = file.size;
-            file.id = info->getFieldData(i, "stmid").toUInt();
-            file.type = static_cast<EmbeddedFile::Type>(
-                        info->getFieldData(i, "stmid").toUInt() != 0x40534656);
-            file.avbps = info->getFieldData(i, "avbps").toLongLong();
+            file.id = static_cast<quint32>(info->u64At(stmid, i));
+            file.type = static_cast<EmbeddedFile::Type>(file.id != 0x40534656);
+            file.avbps = info->s64At(avbps, i);
 
-            ready.insert(info->getFieldData(i, "stmid").toUInt(), false);
+            ready.insert(file.id, false);
 
             files.push_back(file);
         }
 
         delete info;
 
+        // chunks find their stream by ID
+
+        _indexIds();
+        _indexPaths();
+
         // skip footer
 
         seekRel(footerSize);
 
+        endPhase();
+        beginPhase("chunks");
+
         // keep reading as long as not all streams are finished
 
         while (ready.values().contains(false)) {
             Chunk chunk;
             chunk.offset = pos();
 
-            QByteArray id = read(4); // @SFV or @SFA
+            // the chunk header is always 0x20 bytes, so grab it at once and parse it in memory
+
+            QByteArray header = readView(0x20);
 
-            chunk.type = static_cast<Chunk::Type>(id.endsWith('A')); // Booleans map to the enum values
-            chunk.size = readUIntBE();
-            chunk.headerSize = readUShortBE();
-            chunk.footerSize = readUShortBE();
-            chunk.dataType = static_cast<Chunk::DataType>(readUIntBE()); // Also maps to the enum values
+            if (header.size() < 0x20) {
+                break;
+            }
+
+            NaoBinaryCursor cursor(header);
 
-            // ignore possible sanity check bytes (we're insane)
+            quint32 streamId = cursor.readUIntBE(); // @SFV or @SFA
 
-            seekRel(16);
+            chunk.type = static_cast<Chunk::Type>((streamId & 0xFF) == 'A'); // Booleans map to the enum values
+            chunk.size = cursor.readUIntBE();
+            chunk.headerSize = cursor.readUShortBE();
+            chunk.footerSize = cursor.readUShortBE();
+            chunk.dataType = static_cast<Chunk::DataType>(cursor.readUIntBE()); // Also maps to the enum values
+
+            // the remaining 16 bytes are possible sanity check bytes (we're insane)
 
             if (chunk.dataType == Chunk::StreamInfo) {
 
                 // contains another @UTF with some info on our stream
 
-                UTFReader* info = new UTFReader(readNextUTF());
+                UTFReader* info = new UTFReader(readNextUTF(), UTFReader::Lazy);
+
+                const qint64 index = findById(streamId);
 
-                EmbeddedFile& file = *std::find_if(files.begin(), files.end(), [&](const EmbeddedFile& f) { return f.id == readUIntBE(id.data()); });
+                if (index >= 0 && files.at(index).type == EmbeddedFile::Video) {
+                    EmbeddedFile& file = files[index];
 
-                if (file.type == EmbeddedFile::Video) {
-                    file.width = info->getFieldData(0, "width").toLongLong();
-                    file.height = info->getFieldData(0, "height").toLongLong();
-                    file.totalFrames = info->getFieldData(0, "total_frames").toLongLong();
-                    file.nFramerate = info->getFieldData(0, "framerate_n").toLongLong();
-                    file.dFramerate = info->getFieldData(0, "framerate_d").toLongLong();
+                    file.width = info->s64At(info->column("width"), 0);
+                    file.height = info->s64At(info->column("height"), 0);
+                    file.totalFrames = info->s64At(info->column("total_frames"), 0);
+                    file.nFramerate = info->s64At(info->column("framerate_n"), 0);
+                    file.dFramerate = info->s64At(info->column("framerate_d"), 0);
                 }
 
                 delete info;
@@ -197,8 +480,8 @@ void NaoCRIWareReader::startup() {
                 // as long as this chunk does not specify th end of a stream we just skip the contents and save the positions
 
                 if (chunk.size - chunk.headerSize - chunk.footerSize == 0x20) {
-                    if (QString::fromLatin1(read(0x20)) == "#CONTENTS END   ===============" || getDevice()->atEnd()) {
-                        ready[readUIntBE(id.data())] = true;
+                    if (QString::fromLatin1(readView(0x20)) == "#CONTENTS END   ===============" || atEnd()) {
+                        ready[streamId] = true;
                     }
                 } else {
                     seekRel(chunk.size - chunk.headerSize - chunk.footerSize);
@@ -209,384 +492,1029 @@ void NaoCRIWareReader::startup() {
 
             dataChunks.push_back(chunk);
         }
+
+        endPhase();
+    }
+
+    if (cache) {
+        beginPhase("cache");
+
+        cache->store(*this);
+
+        endPhase();
     }
 }
 
 QByteArray NaoCRIWareReader::readNextUTF() {
-    if (read(4) != QByteArray("@UTF", 4))
+    if (readView(4) != QByteArray("@UTF", 4))
         qFatal("Invalid @UTF fourCC found while reading UTF chunk");
 
     quint32 packetSize = readUIntBE() + 8; // first uint is the remaining packet size
 
     seekRel(-8);
 
-    return read(packetSize); // read everything including the fourCC
+    return readView(packetSize); // read everything including the fourCC
 }
 
-bool NaoCRIWareReader::isPak() const {
-    return _isPak;
-}
+void NaoCRIWareReader::_readFilteredTOC(const UTFReader& toc, qint64 extraOffset, QVector<quint32>& rows) {
+    const int fileName = toc.column("FileName");
+    const int dirName = toc.column("DirName");
+    const int userString = (_options.columns & OpenOptions::UserString) ? toc.column("UserString") : -1;
+    const int fileOffset = toc.column("FileOffset");
+    const int fileSize = toc.column("FileSize");
+    const int extractSize = toc.column("ExtractSize");
+    const int id = (_options.columns & OpenOptions::ID) ? toc.column("ID") : -1;
 
-const QVector<NaoCRIWareReader::EmbeddedFile>& NaoCRIWareReader::getFiles() const {
-    return files;
-}
+    NaoNameFilter dirs(_options.dirFilter, _options.syntax);
+    NaoNameFilter names(_options.nameFilter, _options.syntax);
 
-NaoCRIWareReader::UTFReader::UTFReader(QByteArray packet) :
-    NaoFileReader(new QBuffer(&packet)),
-    _fields(new QVector<UTFField>()),
-    _rows(new QVector<QVector<UTFRow>*>()) {
-    if (read(4) != QByteArray("@UTF", 4)) {
-        qFatal("Invalid @UTF fourCC found");
-    }
+    for (quint32 i = 0; i < toc.getRowCount(); i++) {
 
-    // Read the UTF header
+        // the directory first, it's the one most likely to have been seen already. names that were checked before
+        // are recognised by their offset in the string table, without decoding them again
 
-    qint32 tableSize = readUIntBE();
+        if (!dirs.matches(toc, dirName, i) || !names.matches(toc, fileName, i)) {
+            continue;
+        }
 
-    seekRel(1); // unused byte
+        EmbeddedFile file = EmbeddedFile();
 
-    _encodeType = readUChar(); // encoding: Shift-JIS if 0, else UTF-8
-    quint16 rowsOffset = readUShortBE() + 8;
-    quint32 stringsOffset = readUIntBE() + 8;
-    quint32 dataOffset = readUIntBE() + 8;
-    quint32 tableNameOffset = readUIntBE() + 8;
-    fieldCount = readUShortBE();
-    quint16 rowSize = readUShortBE();
-    rowCount = readUIntBE();
+        file.origin = "TOC ";
+        file.name = toc.stringAt(fileName, i);
+        file.path = toc.stringAt(dirName, i);
+        file.offset = toc.s64At(fileOffset, i);
+        file.extraOffset = extraOffset;
+        file.size = toc.s64At(fileSize, i);
+        file.extractedSize = toc.s64At(extractSize, i);
 
-    Q_UNUSED(tableSize);
-    Q_UNUSED(tableNameOffset);
-    Q_UNUSED(rowSize);
+        if (userString >= 0) {
+            file.userString = toc.stringAt(userString, i);
+        }
 
-    // Then read fieldCount fields, consisting of 1 byte flags,
-    // then (if flags & HasName is nonzero) an uint pointing to the field name
+        if (id >= 0) {
+            file.id = static_cast<quint32>(toc.u64At(id, i));
+        }
 
-    for (quint16 i = 0; i < fieldCount; i++) {
-        UTFField field;
-        field.flags = readChar();
+        files.push_back(file);
+        rows.push_back(i);
+    }
+}
 
-        // sanity check for name (wait we were insane weren't we?!)
+void NaoCRIWareReader::_readITOC(const UTFReader& itoc, qint64 contentOffset, qint64 align) {
+    struct Entry {
+        quint32 id;
+        qint64 size;
+        qint64 extractedSize;
+    };
 
-        if (field.flags & HasName) {
-            field.nameOffset = readUIntBE();
+    QVector<Entry> entries;
 
-            qint64 pos = this->pos();
-            seek(stringsOffset + field.nameOffset);
-            field.name = readString();
-            seek(pos);
-        }
+    // DataL has the files whose sizes fit in 16 bits, DataH the rest. both are @UTF tables of their own
 
-        // const values if applicable
+    for (UTFReader::Key table : { UTFReader::Key("DataL"), UTFReader::Key("DataH") }) {
+        const QByteArray data = itoc.dataAt(itoc.column(table), 0);
 
-        if (field.flags & ConstVal) {
-            switch (field.flags & 0x0F) {
-                case uChar:
-                    field.constVal = QVariant::fromValue(readUChar());
-                    break;
+        if (data.isEmpty()) {
+            continue;
+        }
 
-                case sChar:
-                    field.constVal = QVariant::fromValue(readChar());
-                    break;
+        UTFReader rows(data, UTFReader::Lazy);
 
-                case uShort:
-                    field.constVal = QVariant::fromValue(readUShortBE());
-                    break;
+        const int id = rows.column("ID");
+        const int fileSize = rows.column("FileSize");
+        const int extractSize = rows.column("ExtractSize");
 
-                case sShort:
-                    field.constVal = QVariant::fromValue(readShortBE());
-                    break;
+        for (quint32 i = 0; i < rows.getRowCount(); i++) {
+            Entry entry;
+            entry.id = static_cast<quint32>(rows.u64At(id, i));
+            entry.size = rows.s64At(fileSize, i);
+            entry.extractedSize = rows.hasValue(extractSize) ? rows.s64At(extractSize, i) : entry.size;
 
-                case uInt:
-                    field.constVal = QVariant::fromValue(readUIntBE());
-                    break;
+            entries.append(entry);
+        }
+    }
 
-                case sInt:
-                    field.constVal = QVariant::fromValue(readIntBE());
-                    break;
+    // the files are in the archive in ID order, each one aligned
 
-                case uLong:
-                    field.constVal = QVariant::fromValue(readULongBE());
-                    break;
+    std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) { return a.id < b.id; });
 
-                case sLong:
-                    field.constVal = QVariant::fromValue(readLongBE());
-                    break;
+    // there are no directories either, so only nameFilter applies
 
-                case sFloat:
-                    field.constVal = QVariant::fromValue(readFloatBE());
-                    break;
+    NaoNameFilter names(_options.nameFilter, _options.syntax);
 
-                case sDouble:
-                    field.constVal = QVariant::fromValue(readDoubleBE());
-                    break;
+    qint64 offset = contentOffset;
 
-                case String: {
-                    quint32 offset = readUIntBE();
-                    qint64 pos = this->pos();
-                    seek(stringsOffset + offset);
+    for (const Entry& entry : entries) {
 
-                    // read in appropiate encoding. Shift-JIS is still null-terminated, only the byte format is weird.
+        // there are no names, so the ID stands in for one
 
-                    field.constVal = QVariant::fromValue(
-                                QTextCodec::codecForName(
-                                    (_encodeType == 0) ? "Shift-JIS" : "UTF-8")->toUnicode(
-                                        readString().toLatin1()));
-                    seek(pos);
+        EmbeddedFile file = EmbeddedFile();
 
-                    break;
-                }
+        file.origin = "ITOC";
+        file.name = QString::number(entry.id);
+        file.offset = offset;
+        file.extraOffset = 0;
+        file.size = entry.size;
+        file.extractedSize = entry.extractedSize;
+        file.id = entry.id;
 
-                case Data: {
-                    quint32 offset = readUIntBE();
-                    quint32 size = readUIntBE();
-                    qint64 pos = this->pos();
-                    seek(dataOffset + offset);
-                    field.constVal = QVariant::fromValue(read(size));
-                    seek(pos);
+        if (names.matches(file.name)) {
+            files.push_back(file);
+        }
 
-                    break;
-                }
-            }
+        offset += entry.size;
+
+        if (align > 1 && (offset % align) != 0) {
+            offset += align - (offset % align);
         }
+    }
+}
 
-        _fields->append(field);
+void NaoCRIWareReader::_readGTOC() {
+    _groups.clear();
+    _groupAttributes.clear();
+
+    if (!_gtocUTF) {
+        return;
     }
 
-    seek(rowsOffset);
+    // Gdata and Attrdata are @UTF tables of their own, like the ITOC's DataL and DataH
 
-    for (quint32 j = 0; j < rowCount; j++) {
-        QVector<UTFRow>* rows = new QVector<UTFRow>();
+    const QByteArray gdata = _gtocUTF->dataAt(_gtocUTF->column("Gdata"), 0);
 
-        for (quint16 i = 0; i < fieldCount; i++) {
-            UTFRow row;
+    if (!gdata.isEmpty()) {
+        UTFReader rows(gdata, UTFReader::Lazy);
 
-            quint32 storageFlag = _fields->at(i).flags & 0xF0;
+        const int name = rows.column("Gname");
+        const int child = rows.column("Child");
+        const int next = rows.column("Next");
 
-            // skip if we already have a constant value
+        _groups.reserve(static_cast<int>(rows.getRowCount()));
 
-            if (storageFlag & ConstVal) {
-                row.val = _fields->at(i).constVal;
-                rows->append(row);
+        for (quint32 i = 0; i < rows.getRowCount(); i++) {
+            Group group;
+            group.name = rows.stringAt(name, i);
+            group.child = rows.s64At(child, i);
+            group.next = rows.s64At(next, i);
 
-                continue;
-            } else if (storageFlag & RowVal) {
+            _groups.append(group);
+        }
+    }
 
-                // more of a sanity check (oops)
+    const QByteArray attrdata = _gtocUTF->dataAt(_gtocUTF->column("Attrdata"), 0);
 
-                row.type = _fields->at(i).flags & 0x0F;
-                row.pos = pos();
+    if (!attrdata.isEmpty()) {
+        UTFReader rows(attrdata, UTFReader::Lazy);
 
-                switch (row.type) {
-                    case uChar:
-                        row.val = QVariant::fromValue(readUChar());
-                        break;
+        const int name = rows.column("Aname");
+        const int align = rows.column("Align");
+        const int files = rows.column("Files");
+        const int fileSize = rows.column("FileSize");
 
-                    case sChar:
-                        row.val = QVariant::fromValue(readChar());
-                        break;
+        _groupAttributes.reserve(static_cast<int>(rows.getRowCount()));
 
-                    case uShort:
-                        row.val = QVariant::fromValue(readUShortBE());
-                        break;
+        for (quint32 i = 0; i < rows.getRowCount(); i++) {
+            GroupAttribute attribute;
+            attribute.name = rows.stringAt(name, i);
+            attribute.align = static_cast<quint32>(rows.u64At(align, i));
+            attribute.files = static_cast<quint32>(rows.u64At(files, i));
+            attribute.size = rows.u64At(fileSize, i);
 
-                    case sShort:
-                        row.val = QVariant::fromValue(readShortBE());
-                        break;
+            _groupAttributes.append(attribute);
+        }
+    }
+}
 
-                    case uInt:
-                        row.val = QVariant::fromValue(readUIntBE());
-                        break;
+void NaoCRIWareReader::_indexIds() {
+    _denseIds.clear();
+    _sparseIds.clear();
 
-                    case sInt:
-                        row.val = QVariant::fromValue(readIntBE());
-                        break;
+    // without the ID column every TOC entry has ID 0, that's no use to anyone. ITOC entries are found by
+    // their ID, so those always have one
 
-                    case uLong:
-                        row.val = QVariant::fromValue(readULongBE());
-                        break;
+    const bool tocIds = !_isPak || (_options.columns & OpenOptions::ID);
 
-                    case sLong:
-                        row.val = QVariant::fromValue(readLongBE());
-                        break;
+    auto hasId = [tocIds](const EmbeddedFile& file) {
+        return tocIds || file.origin == "ITOC";
+    };
 
-                    case sFloat:
-                        row.val = QVariant::fromValue(readFloatBE());
-                        break;
+    quint32 maxId = 0;
+    int withId = 0;
 
-                    case sDouble:
-                        row.val = QVariant::fromValue(readDoubleBE());
-                        break;
+    for (const EmbeddedFile& file : files) {
+        if (hasId(file)) {
+            maxId = qMax(maxId, file.id);
+            withId++;
+        }
+    }
 
-                    case String: {
-                        quint32 offset = readUIntBE();
-                        qint64 pos = this->pos();
+    if (withId == 0) {
+        return;
+    }
 
-                        seek(stringsOffset + offset);
-                        row.val = QVariant::fromValue(
-                                    QTextCodec::codecForName(
-                                        (_encodeType == 0) ? "Shift-JIS" : "UTF-8")->toUnicode(
-                                            readString().toLatin1()));
-                        seek(pos);
+    // a table at most a few times bigger than the file list, IDs past that go in the hash
 
-                        break;
-                    }
+    const bool dense = static_cast<qint64>(maxId) < qMax<qint64>(files.size() * 4LL, 0x10000);
 
-                    case Data: {
-                        quint32 offset = readUIntBE();
-                        quint32 size = readUIntBE();
-                        qint64 pos = this->pos();
-                        seek(dataOffset + offset);
-                        row.val = QVariant::fromValue(read(size));
-                        seek(pos);
+    if (dense) {
+        _denseIds.fill(-1, static_cast<int>(maxId) + 1);
+    }
 
-                        break;
-                    }
-                }
-            } else {
-                row.val = QVariant();
-            }
+    for (int i = 0; i < files.size(); i++) {
+        if (!hasId(files.at(i))) {
+            continue;
+        }
+
+        const quint32 id = files.at(i).id;
 
-            rows->append(row);
+        if (dense) {
+            if (_denseIds.at(static_cast<int>(id)) < 0) {
+                _denseIds[static_cast<int>(id)] = i;
+            }
+        } else if (!_sparseIds.contains(id)) {
+            _sparseIds.insert(id, i);
         }
+    }
+}
 
-        _rows->append(rows);
+qint64 NaoCRIWareReader::findById(quint32 id) const {
+    if (!_denseIds.isEmpty()) {
+        return (id < static_cast<quint32>(_denseIds.size())) ? _denseIds.at(static_cast<int>(id)) : -1;
     }
+
+    return _sparseIds.value(id, -1);
 }
 
-QVector<NaoCRIWareReader::UTFReader::UTFField>* NaoCRIWareReader::UTFReader::getFields() const {
-    return _fields;
+void NaoCRIWareReader::_indexPaths() {
+    QVector<QString> paths;
+    paths.reserve(files.size());
+
+    for (const EmbeddedFile& file : files) {
+        paths.append(file.path.isEmpty() ? file.name : (file.path + '/' + file.name));
+    }
+
+    _paths = NaoPathIndex(paths);
 }
 
-QVector<QVector<NaoCRIWareReader::UTFReader::UTFRow>*>* NaoCRIWareReader::UTFReader::getRows() const {
-    return _rows;
+qint64 NaoCRIWareReader::findByPath(const QString& path) const {
+    return _paths.find(path);
 }
 
-quint16 NaoCRIWareReader::UTFReader::getFieldCount() const {
-    return fieldCount;
+const NaoPathIndex& NaoCRIWareReader::pathIndex() const {
+    return _paths;
 }
 
-quint32 NaoCRIWareReader::UTFReader::getRowCount() const {
-    return rowCount;
+const NaoCRIWareReader::UTFReader* NaoCRIWareReader::gtoc() const {
+    return _gtocUTF;
 }
 
-QVariant NaoCRIWareReader::UTFReader::getFieldData(quint32 row, QString name) const {
+const QVector<NaoCRIWareReader::Group>& NaoCRIWareReader::groups() const {
+    return _groups;
+}
 
-    // we could use std::find_if, but then  again, we could also not (number of files shouldn't be too crazy anyway)
+const QVector<NaoCRIWareReader::GroupAttribute>& NaoCRIWareReader::groupAttributes() const {
+    return _groupAttributes;
+}
 
-    for (quint16 i = 0; i < fieldCount; i++) {
-        if (_fields->at(i).name == name) {
-            return _rows->at(row)->at(i).val;
-        }
-    }
+bool NaoCRIWareReader::isPak() const {
+    return _isPak;
+}
 
-    return QVariant();
+const QVector<NaoCRIWareReader::EmbeddedFile>& NaoCRIWareReader::getFiles() const {
+    return files;
 }
 
-bool NaoCRIWareReader::UTFReader::hasField(QString name) const {
-    for (quint16 i = 0; i < fieldCount; i++) {
-        if (_fields->at(i).name == name) {
-            return true;
-        }
+// bytes a value of type takes in a row (or after the field for const values), strings are an offset, data an offset and a size
+static int utfWidth(quint32 type) {
+    switch (type) {
+        case NaoCRIWareReader::UTFReader::uChar:
+        case NaoCRIWareReader::UTFReader::sChar:
+            return 1;
+
+        case NaoCRIWareReader::UTFReader::uShort:
+        case NaoCRIWareReader::UTFReader::sShort:
+            return 2;
+
+        case NaoCRIWareReader::UTFReader::uInt:
+        case NaoCRIWareReader::UTFReader::sInt:
+        case NaoCRIWareReader::UTFReader::sFloat:
+        case NaoCRIWareReader::UTFReader::String:
+            return 4;
+
+        case NaoCRIWareReader::UTFReader::uLong:
+        case NaoCRIWareReader::UTFReader::sLong:
+        case NaoCRIWareReader::UTFReader::sDouble:
+        case NaoCRIWareReader::UTFReader::Data:
+            return 8;
+
+        default:
+            return 0;
     }
-
-    return false;
 }
 
-QByteArray NaoCRIWareReader::extractFileAt(qint64 index) {
-
-    // in-memory extraction
+// a big endian value of width bytes, zero extended
+static quint64 utfLoad(const uchar* p, int width) {
+    switch (width) {
+        case 1:
+            return *p;
 
-    EmbeddedFile file = files.at(index);
+        case 2:
+            return NaoBytes::load<quint16, NaoEndian::Big>(p);
 
-    if (_isPak) {
-        seek(file.extraOffset + file.offset);
-        return (file.size == file.extractedSize) ? read(file.size) : decompressCRILAYLA(read(file.size));
-    } else {
-        QVector<Chunk> chunks;
+        case 4:
+            return NaoBytes::load<quint32, NaoEndian::Big>(p);
 
-        // gather all data chunks
+        case 8:
+            return NaoBytes::load<quint64, NaoEndian::Big>(p);
 
-        for (QVector<Chunk>::iterator it = dataChunks.begin();
-             it != dataChunks.end(); ++it) {
-            Chunk chunk = *it;
+        default:
+            return 0;
+    }
+}
 
-            if (chunk.type == static_cast<Chunk::Type>(file.type) && chunk.dataType == Chunk::Data) {
-                chunks.push_back(chunk);
-            }
-        }
+NaoCRIWareReader::UTFReader::UTFReader(QByteArray packet, Decoding decoding) :
+    _decoding(decoding) {
 
-        QByteArray output;
+    // with Lazy everything is read straight from the packet later on, so hold on to it
 
-        // read all data those chunks point to
+    if (_decoding == Lazy) {
+        _packet = packet;
+    }
 
-        for (QVector<Chunk>::iterator it = chunks.begin();
-             it != chunks.end(); ++it) {
-            Chunk chunk = *it;
+    const QByteArray& data = (_decoding == Lazy) ? _packet : packet;
 
-            seek(chunk.offset + chunk.headerSize);
+    // the packet is already in memory, so just walk over it
 
-            output.append(read(chunk.size - chunk.headerSize - chunk.footerSize));
-        }
+    NaoBinaryCursor cursor(data);
 
-        return output;
+    if (cursor.read(4) != QByteArray("@UTF", 4)) {
+        qFatal("Invalid @UTF fourCC found");
     }
-}
 
-bool NaoCRIWareReader::extractFileTo(qint64 index, QIODevice* device) {
+    // Read the UTF header
 
-    // extract to a QIODevice in chunks equal to the page size of the filesystem (if the QIODevice is in memory, well tough)
+    qint32 tableSize = cursor.readUIntBE();
 
-    if (!device->isWritable()) {
-        device->open(QIODevice::WriteOnly);
+    cursor.seekRel(1); // unused byte
 
-        if (!device->isWritable()) {
-            return false;
+    _encodeType = cursor.readUChar(); // encoding: Shift-JIS if 0, else UTF-8
+    quint16 rowsOffset = cursor.readUShortBE() + 8;
+    _stringsOffset = cursor.readUIntBE() + 8;
+    _dataOffset = cursor.readUIntBE() + 8;
+    quint32 tableNameOffset = cursor.readUIntBE() + 8;
+    fieldCount = cursor.readUShortBE();
+    _rowSize = cursor.readUShortBE();
+    rowCount = cursor.readUIntBE();
+
+    Q_UNUSED(tableSize);
+    Q_UNUSED(tableNameOffset);
+
+    if (_stringsOffset > static_cast<quint32>(data.size())) {
+        qFatal("@UTF strings offset out of bounds");
+    }
+
+    if (_decoding == Lazy) {
+        _tail = QByteArray::fromRawData(data.constData() + _stringsOffset, data.size() - static_cast<int>(_stringsOffset));
+    } else {
+
+        // strings and data are all we need from the packet once it's parsed, keep our own copy of those
+        // since the packet may just be a view into a mapped file
+
+        _tail = QByteArray(data.constData() + _stringsOffset, data.size() - static_cast<int>(_stringsOffset));
+    }
+
+    _encoding = (_encodeType == 0) ? NaoText::ShiftJIS : NaoText::UTF8;
+
+    // decode the whole string table once for Eager. cells point at these by offset and lots of them share one
+    // (every file in a directory has the same DirName), so they all end up sharing one QString.
+    // Lazy decodes a string the first time it's read instead, see _lazyString()
+
+    const qint64 stringsSize = (_decoding == Eager)
+            ? qBound<qint64>(0, static_cast<qint64>(_dataOffset) - _stringsOffset, _tail.size()) : 0;
+
+    for (qint64 pos = 0; pos < stringsSize;) {
+        const char* start = _tail.constData() + pos;
+        const char* end = static_cast<const char*>(memchr(start, '\0', stringsSize - pos));
+        const qint64 size = end ? (end - start) : (stringsSize - pos);
+
+        _stringIds.insert(static_cast<quint32>(pos), static_cast<quint32>(_strings.size()));
+        _strings.append(NaoText::decode(_encoding, start, static_cast<int>(size)));
+
+        pos += size + 1;
+    }
+
+    // Then read fieldCount fields, consisting of 1 byte flags,
+    // then (if flags & HasName is nonzero) an uint pointing to the field name, then the const value if there is one
+
+    _columns.reserve(fieldCount);
+
+    int rowWidth = 0;
+
+    for (quint16 i = 0; i < fieldCount; i++) {
+        Column column;
+        column.flags = cursor.readUChar();
+        column.nameOffset = 0;
+        column.width = utfWidth(column.flags & 0x0F);
+        column.constVal = 0;
+
+        // sanity check for name (wait we were insane weren't we?!)
+
+        if (column.flags & HasName) {
+            column.nameOffset = cursor.readUIntBE();
+
+            QByteArray name = cursor.stringAt(_stringsOffset + column.nameOffset);
+            column.name = NaoText::decode(_encoding, name);
+
+            // the first column with a name wins, like it always has. hashed as UTF-8 like every Key,
+            // so a name that isn't ASCII is found by a literal as well
+
+            quint32 hash = Key(column.name).hash();
+
+            if (!_columnsByHash.contains(hash)) {
+                _columnsByHash.insert(hash, i);
+            }
+        }
+
+        // where it is inside a row, if it's in there
+
+        column.rowOffset = rowWidth;
+
+        if (column.flags & ConstVal) {
+            column.constVal = utfLoad(cursor.take(column.width), column.width);
+
+            if ((column.flags & 0x0F) == String) {
+                column.constVal = _intern(static_cast<quint32>(column.constVal));
+            }
+        } else if (column.flags & RowVal) {
+            rowWidth += column.width;
         }
+
+        _columns.append(column);
     }
 
-    EmbeddedFile file = files.at(index);
+    // rows are fixed size, rowSize apart
 
-    // get the page size from Windows
+    if (rowCount > 0 && _rowSize < rowWidth) {
+        qFatal("@UTF row size smaller than its fields");
+    }
 
-    SYSTEM_INFO inf;
-    GetNativeSystemInfo(&inf);
-    const quint32 targetBlockSize = inf.dwPageSize;
+    _rowData = cursor.at(rowsOffset, static_cast<qint64>(_rowSize) * rowCount);
 
-    if (_isPak) {
-        seek(file.extraOffset + file.offset);
+    if (_decoding == Lazy) {
 
-        // if the file is compressed we have no choice but to still completely load it into memory. This is fine because compressed files usually have limited size.
+        // cells are decoded from the packet when they're asked for
 
-        if (file.size == file.extractedSize) {
-            qint64 remaining = file.size;
-            qint64 hold = 0;
+        return;
+    }
 
-            // read targetBlockSize bytes as long as we can
+    // fill the columns one row at a time, converting to host order as we go
 
-            while (remaining >= targetBlockSize) {
-                device->write(read(targetBlockSize));
+    for (Column& column : _columns) {
+        if ((column.flags & ConstVal) == 0 && (column.flags & RowVal) && column.width > 0) {
+            column.values.resize(column.width * static_cast<int>(rowCount));
+        }
+    }
 
-                remaining -= targetBlockSize;
-                hold += targetBlockSize;
+    for (quint32 j = 0; j < rowCount; j++) {
+        const uchar* row = _rowData + static_cast<qint64>(j) * _rowSize;
+
+        for (Column& column : _columns) {
+            if ((column.flags & ConstVal) || !(column.flags & RowVal) || column.width == 0) {
+                continue;
+            }
+
+            const uchar* src = row + column.rowOffset;
+            char* dst = column.values.data() + static_cast<qint64>(j) * column.width;
 
-                // prevents spamming signals/slots
+            switch (column.width) {
+                case 1:
+                    *dst = static_cast<char>(*src);
+                    break;
 
-                if (hold % (targetBlockSize * 32) == 0) {
-                    emit extractProgress(file.size - remaining, file.size);
+                case 2: {
+                    quint16 v = NaoBytes::load<quint16, NaoEndian::Big>(src);
+                    memcpy(dst, &v, 2);
+                    break;
+                }
+
+                case 4: {
+                    quint32 v = NaoBytes::load<quint32, NaoEndian::Big>(src);
+
+                    // strings are kept as their id in the pool
+
+                    if ((column.flags & 0x0F) == String) {
+                        v = _intern(v);
+                    }
+
+                    memcpy(dst, &v, 4);
+                    break;
+                }
+
+                case 8: {
+                    quint64 v = NaoBytes::load<quint64, NaoEndian::Big>(src);
+                    memcpy(dst, &v, 8);
+                    break;
                 }
             }
+        }
+    }
+
+    // the rows were only needed for that
+
+    _rowData = nullptr;
+}
+
+NaoCRIWareReader::UTFReader::~UTFReader() {
+    if (_rows) {
+        qDeleteAll(*_rows);
+    }
+
+    delete _rows;
+    delete _fields;
+}
+
+quint64 NaoCRIWareReader::UTFReader::_raw(const Column& column, quint32 row) const {
+    if (column.flags & ConstVal) {
+        return column.constVal;
+    } else if (row >= rowCount || !(column.flags & RowVal)) {
+        return 0;
+    } else if (_decoding == Lazy) {
+        return utfLoad(_rowData + static_cast<qint64>(row) * _rowSize + column.rowOffset, column.width);
+    } else if (column.values.isEmpty()) {
+        return 0;
+    }
+
+    const char* p = column.values.constData() + static_cast<qint64>(row) * column.width;
+
+    switch (column.width) {
+        case 1:
+            return static_cast<uchar>(*p);
+
+        case 2: {
+            quint16 v;
+            memcpy(&v, p, 2);
+            return v;
+        }
+
+        case 4: {
+            quint32 v;
+            memcpy(&v, p, 4);
+            return v;
+        }
+
+        default: {
+            quint64 v;
+            memcpy(&v, p, 8);
+            return v;
+        }
+    }
+}
+
+QVariant NaoCRIWareReader::UTFReader::_variant(int column, quint32 row) const {
+
+    // the same types the QVariant based parser used to produce
+
+    if (!hasValue(column)) {
+        return QVariant();
+    }
+
+    quint64 v = _raw(_columns.at(column), row);
+
+    switch (typeOf(column)) {
+        case uChar:
+            return QVariant::fromValue(static_cast<quint8>(v));
+
+        case sChar:
+            return QVariant::fromValue(static_cast<qint8>(v));
+
+        case uShort:
+            return QVariant::fromValue(static_cast<quint16>(v));
+
+        case sShort:
+            return QVariant::fromValue(static_cast<qint16>(v));
+
+        case uInt:
+            return QVariant::fromValue(static_cast<quint32>(v));
+
+        case sInt:
+            return QVariant::fromValue(static_cast<qint32>(v));
+
+        case uLong:
+            return QVariant::fromValue(v);
+
+        case sLong:
+            return QVariant::fromValue(static_cast<qint64>(v));
+
+        case sFloat: {
+            quint32 bits = static_cast<quint32>(v);
+            float f;
+            memcpy(&f, &bits, 4);
+
+            return QVariant::fromValue(f);
+        }
+
+        case sDouble: {
+            double d;
+            memcpy(&d, &v, 8);
+
+            return QVariant::fromValue(d);
+        }
+
+        case String:
+            return QVariant::fromValue(stringAt(column, row));
+
+        case Data:
+            return QVariant::fromValue(dataAt(column, row));
+
+        default:
+            return QVariant();
+    }
+}
+
+QVector<NaoCRIWareReader::UTFReader::UTFField>* NaoCRIWareReader::UTFReader::getFields() const {
+    if (!_fields) {
+        _fields = new QVector<UTFField>();
+
+        for (int i = 0; i < _columns.size(); i++) {
+            const Column& column = _columns.at(i);
+
+            UTFField field;
+            field.flags = static_cast<char>(column.flags);
+            field.nameOffset = column.nameOffset;
+            field.name = column.name;
+
+            if (column.flags & ConstVal) {
+                field.constVal = _variant(i, 0);
+            }
+
+            _fields->append(field);
+        }
+    }
+
+    return _fields;
+}
 
-            // read remaining bytes
+QVector<QVector<NaoCRIWareReader::UTFReader::UTFRow>*>* NaoCRIWareReader::UTFReader::getRows() const {
+    if (!_rows) {
+        _rows = new QVector<QVector<UTFRow>*>();
 
-            if (remaining > 0) {
-                device->write(read(remaining));
+        for (quint32 j = 0; j < rowCount; j++) {
+            QVector<UTFRow>* rows = new QVector<UTFRow>();
 
-                remaining = 0;
+            for (int i = 0; i < _columns.size(); i++) {
+                UTFRow row;
+                row.type = typeOf(i);
+                row.pos = 0;
+                row.val = _variant(i, j);
 
-                emit extractProgress(file.size, file.size);
+                rows->append(row);
             }
+
+            _rows->append(rows);
+        }
+    }
+
+    return _rows;
+}
+
+quint16 NaoCRIWareReader::UTFReader::getFieldCount() const {
+    return fieldCount;
+}
+
+quint32 NaoCRIWareReader::UTFReader::getRowCount() const {
+    return rowCount;
+}
+
+QVariant NaoCRIWareReader::UTFReader::getFieldData(quint32 row, QString name) const {
+    int i = column(name);
+
+    if (i < 0 || row >= rowCount) {
+        return QVariant();
+    }
+
+    return _variant(i, row);
+}
+
+bool NaoCRIWareReader::UTFReader::hasField(QString name) const {
+    return column(name) >= 0;
+}
+
+NaoCRIWareReader::UTFReader::Key::Key(const QString& name) :
+    _string(&name),
+    _hash(0x811C9DC5U) {
+
+    // the UTF-8 bytes of the name, which is what literals hash. encoded as we go so ASCII names don't allocate
+
+    auto add = [this](uint byte) {
+        _hash = (_hash ^ static_cast<uchar>(byte)) * 0x01000193U;
+    };
+
+    for (int i = 0; i < name.size(); i++) {
+        uint c = name.at(i).unicode();
+
+        if (QChar::isHighSurrogate(c) && i + 1 < name.size() && name.at(i + 1).isLowSurrogate()) {
+            c = QChar::surrogateToUcs4(static_cast<ushort>(c), name.at(++i).unicode());
+        }
+
+        if (c < 0x80) {
+            add(c);
+        } else if (c < 0x800) {
+            add(0xC0 | (c >> 6));
+            add(0x80 | (c & 0x3F));
+        } else if (c < 0x10000) {
+            add(0xE0 | (c >> 12));
+            add(0x80 | ((c >> 6) & 0x3F));
+            add(0x80 | (c & 0x3F));
         } else {
-            device->write(decompressCRILAYLA(read(file.size)));
+            add(0xF0 | (c >> 18));
+            add(0x80 | ((c >> 12) & 0x3F));
+            add(0x80 | ((c >> 6) & 0x3F));
+            add(0x80 | (c & 0x3F));
+        }
+    }
+}
+
+bool NaoCRIWareReader::UTFReader::Key::matches(const QString& name) const {
+    return _string ? (name == *_string) : (name == QString::fromUtf8(_name, _size));
+}
+
+int NaoCRIWareReader::UTFReader::column(const QString& name) const {
+    return column(Key(name));
+}
+
+int NaoCRIWareReader::UTFReader::column(Key key) const {
+    QHash<quint32, int>::const_iterator it = _columnsByHash.constFind(key.hash());
+
+    if (it == _columnsByHash.constEnd()) {
+        return -1;
+    } else if (key.matches(_columns.at(it.value()).name)) {
+        return it.value();
+    }
+
+    // a hash collision, rare enough to just look through all of them
+
+    for (int i = 0; i < _columns.size(); i++) {
+        if (key.matches(_columns.at(i).name)) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+bool NaoCRIWareReader::UTFReader::hasValue(int column) const {
+    return column >= 0 && column < _columns.size() && (_columns.at(column).flags & (ConstVal | RowVal));
+}
+
+quint32 NaoCRIWareReader::UTFReader::typeOf(int column) const {
+    return (column >= 0 && column < _columns.size()) ? (_columns.at(column).flags & 0x0F) : 0;
+}
+
+quint64 NaoCRIWareReader::UTFReader::u64At(int column, quint32 row) const {
+    return static_cast<quint64>(s64At(column, row));
+}
+
+qint64 NaoCRIWareReader::UTFReader::s64At(int column, quint32 row) const {
+    if (!hasValue(column)) {
+        return 0;
+    }
+
+    const Column& c = _columns.at(column);
+    quint64 v = _raw(c, row);
+
+    switch (c.flags & 0x0F) {
+        case uChar:
+        case uShort:
+        case uInt:
+        case uLong:
+            return static_cast<qint64>(v);
+
+        case sChar:
+            return static_cast<qint8>(v);
+
+        case sShort:
+            return static_cast<qint16>(v);
+
+        case sInt:
+            return static_cast<qint32>(v);
+
+        case sLong:
+            return static_cast<qint64>(v);
+
+        case sFloat:
+        case sDouble:
+            return static_cast<qint64>(doubleAt(column, row));
+
+        default:
+            return 0;
+    }
+}
+
+double NaoCRIWareReader::UTFReader::doubleAt(int column, quint32 row) const {
+    if (!hasValue(column)) {
+        return 0.;
+    }
+
+    const Column& c = _columns.at(column);
+    quint64 v = _raw(c, row);
+
+    if ((c.flags & 0x0F) == sFloat) {
+        quint32 bits = static_cast<quint32>(v);
+        float f;
+        memcpy(&f, &bits, 4);
+
+        return f;
+    } else if ((c.flags & 0x0F) == sDouble) {
+        double d;
+        memcpy(&d, &v, 8);
+
+        return d;
+    }
+
+    return static_cast<double>(s64At(column, row));
+}
+
+QString NaoCRIWareReader::UTFReader::stringAt(int column, quint32 row) const {
+    if (typeOf(column) != String || !hasValue(column)) {
+        return QString();
+    }
+
+    const Column& c = _columns.at(column);
+
+    if (!(c.flags & ConstVal) && row >= rowCount) {
+        return QString();
+    }
+
+    quint32 v = static_cast<quint32>(_raw(c, row));
+
+    // const values and eagerly decoded rows hold a pool id, lazy rows still point into the string table
+
+    if ((c.flags & ConstVal) || _decoding == Eager) {
+        return _strings.at(static_cast<int>(v));
+    }
+
+    return _lazyString(v);
+}
+
+QString NaoCRIWareReader::UTFReader::_lazyString(quint32 offset) const {
+
+    // decoded on first use only, and kept so cells pointing at the same offset share it
+
+    QHash<quint32, QString>::const_iterator it = _lazyStrings.constFind(offset);
+
+    if (it != _lazyStrings.constEnd()) {
+        return it.value();
+    }
+
+    const QString str = _decodeString(offset);
+    _lazyStrings.insert(offset, str);
+
+    return str;
+}
+
+quint32 NaoCRIWareReader::UTFReader::stringKeyAt(int column, quint32 row) const {
+    if (typeOf(column) != String || !hasValue(column)) {
+        return 0xFFFFFFFFU;
+    }
+
+    const Column& c = _columns.at(column);
+
+    if (!(c.flags & ConstVal) && row >= rowCount) {
+        return 0xFFFFFFFFU;
+    }
+
+    // the string table offset for lazy rows, the pool id otherwise
+
+    return static_cast<quint32>(_raw(c, row));
+}
+
+quint32 NaoCRIWareReader::UTFReader::_intern(quint32 offset) {
+    QHash<quint32, quint32>::const_iterator it = _stringIds.constFind(offset);
+
+    if (it != _stringIds.constEnd()) {
+        return it.value();
+    }
+
+    // an offset into the middle of another string, they can share a tail
+
+    quint32 id = static_cast<quint32>(_strings.size());
+
+    _strings.append(_decodeString(offset));
+    _stringIds.insert(offset, id);
+
+    return id;
+}
+
+QString NaoCRIWareReader::UTFReader::_decodeString(quint32 offset) const {
+
+    // read in appropiate encoding. Shift-JIS is still null-terminated, only the byte format is weird.
+
+    NaoBinaryCursor strings(_tail);
+
+    return NaoText::decode(_encoding, strings.stringAt(offset));
+}
+
+QByteArray NaoCRIWareReader::UTFReader::dataAt(int column, quint32 row) const {
+    if (typeOf(column) != Data || !hasValue(column)) {
+        return QByteArray();
+    }
+
+    return _dataAt(_raw(_columns.at(column), row));
+}
+
+QByteArray NaoCRIWareReader::UTFReader::_dataAt(quint64 v) const {
+    qint64 offset = static_cast<qint64>(_dataOffset) - _stringsOffset + static_cast<quint32>(v >> 32);
+    qint64 size = static_cast<quint32>(v);
+
+    NaoBinaryCursor data(_tail);
+
+    return QByteArray(reinterpret_cast<const char*>(data.at(offset, size)), static_cast<int>(size));
+}
+
+QByteArray NaoCRIWareReader::extractFileAt(qint64 index) {
+
+    // in-memory extraction, only positional reads so this may run on multiple threads at once
+
+    const EmbeddedFile& file = files.at(index);
+
+    if (_isPak) {
+        qint64 offset = file.extraOffset + file.offset;
+        return (file.size == file.extractedSize) ? readAt(offset, file.size) : decompressCRILAYLA(viewAt(offset, file.size));
+    } else {
+        QVector<Chunk> chunks;
+
+        // gather all data chunks
+
+        for (QVector<Chunk>::iterator it = dataChunks.begin();
+             it != dataChunks.end(); ++it) {
+            Chunk chunk = *it;
+
+            if (chunk.type == static_cast<Chunk::Type>(file.type) && chunk.dataType == Chunk::Data) {
+                chunks.push_back(chunk);
+            }
+        }
+
+        QByteArray output;
+
+        // read all data those chunks point to
+
+        for (QVector<Chunk>::iterator it = chunks.begin();
+             it != chunks.end(); ++it) {
+            Chunk chunk = *it;
+
+            output.append(viewAt(chunk.offset + chunk.headerSize, chunk.size - chunk.headerSize - chunk.footerSize));
+        }
+
+        return output;
+    }
+}
+
+QByteArray NaoCRIWareReader::viewFileAt(qint64 index) {
+
+    // stored files in a mapped archive can be handed out as-is
+
+    const EmbeddedFile& file = files.at(index);
+
+    if (_isPak && isMapped() && file.size == file.extractedSize) {
+        return viewAt(file.extraOffset + file.offset, file.size);
+    }
+
+    return extractFileAt(index);
+}
+
+bool NaoCRIWareReader::extractFileTo(qint64 index, QIODevice* device) {
+
+    // extract to a QIODevice a block at a time (see ioPolicy())
+    // only positional reads, so multiple threads may extract (to different devices) at once
+
+    if (!openForWriting(device)) {
+        return false;
+    }
+
+    const EmbeddedFile& file = files.at(index);
+
+    if (_isPak) {
+        qint64 offset = file.extraOffset + file.offset;
+
+        if (file.size == file.extractedSize) {
+
+            // copy in blocks, reading ahead while we write (prevents spamming signals/slots as well)
+
+            bool ok = copyTo(device, offset, file.size, [&](qint64 done) {
+                emit extractProgress(done, file.size);
+            });
+
+            if (!ok) {
+                return false;
+            }
+        } else {
+            bool ok = _decompressTo(viewAt(offset, file.size), file.extractedSize, device, [&](qint64 done) {
+                emit extractProgress(done, file.extractedSize);
+            });
+
+            if (!ok) {
+                return false;
+            }
         }
 
         return true;
@@ -616,27 +1544,59 @@ bool NaoCRIWareReader::extractFileTo(qint64 index, QIODevice* device) {
              it != chunks.end(); ++it) {
             Chunk chunk = *it;
 
-            seek(chunk.offset + chunk.headerSize);
+            qint64 size = chunk.size - chunk.headerSize - chunk.footerSize;
 
-            qint64 remaining = chunk.size - chunk.headerSize - chunk.footerSize;
+            bool ok = copyTo(device, chunk.offset + chunk.headerSize, size, [&](qint64 chunkDone) {
+                emit extractProgress(done + chunkDone, totalSize);
+            });
 
-            while (remaining >= targetBlockSize) {
-                device->write(read(targetBlockSize));
+            if (!ok) {
+                return false;
+            }
 
-                remaining -= targetBlockSize;
-                done += targetBlockSize;
+            done += size;
+        }
 
-                if (done % (targetBlockSize * 32) == 0) {
-                    emit extractProgress(done, totalSize);
-                }
-            }
+        return true;
+    }
+}
 
-            if (remaining > 0) {
-                device->write(read(remaining));
+bool NaoCRIWareReader::extractFileInto(qint64 index, char* dst, qint64 capacity) {
+    const EmbeddedFile& file = files.at(index);
 
-                done += remaining;
+    if (_isPak) {
+        qint64 offset = file.extraOffset + file.offset;
+
+        if (capacity < file.extractedSize) {
+            return false;
+        }
+
+        if (file.size == file.extractedSize) {
+            return readAt(offset, file.size, dst) == file.size;
+        }
+
+        QByteArray data = viewAt(offset, file.size);
+        const uchar* in = reinterpret_cast<const uchar*>(data.constData());
+
+        // the table and the CRILAYLA header should agree, don't trust either blindly
+
+        if (NaoCRILAYLA::decompressedSize(in, data.size()) != file.extractedSize) {
+            return false;
+        }
+
+        return NaoCRILAYLA::decompress(in, data.size(), reinterpret_cast<uchar*>(dst), capacity);
+    } else {
+        qint64 done = 0;
+
+        for (const Chunk& chunk : dataChunks) {
+            if (chunk.type == static_cast<Chunk::Type>(file.type) && chunk.dataType == Chunk::Data) {
+                qint64 size = chunk.size - chunk.headerSize - chunk.footerSize;
 
-                emit extractProgress(done, totalSize);
+                if (done + size > capacity || readAt(chunk.offset + chunk.headerSize, size, dst + done) != size) {
+                    return false;
+                }
+
+                done += size;
             }
         }
 
@@ -644,101 +1604,328 @@ bool NaoCRIWareReader::extractFileTo(qint64 index, QIODevice* device) {
     }
 }
 
-quint16 NaoCRIWareReader::getBits(char* input, quint64* offset, uchar* bitpool, quint8* remaining, quint64 bits) {
+bool NaoCRIWareReader::_decompressTo(const QByteArray& data, qint64 extractedSize, QIODevice* device,
+                                     const std::function<void(qint64)>& progress, QByteArray* scratch) const {
+    const uchar* in = reinterpret_cast<const uchar*>(data.constData());
 
-    // WARNING: DIRTY C CODE IN C++
-    // Reads bits from input, storing bits in bitpool (etc)
+    // the table and the CRILAYLA header should agree, don't trust either blindly
 
-    quint16 output = 0;
-    quint64 outbits = 0;
-    quint64 bitsNow = 0;
+    if (NaoCRILAYLA::decompressedSize(in, data.size()) != extractedSize) {
+        return false;
+    }
 
-    while (outbits < bits) {
-        if (*remaining == 0) {
-            *bitpool = input[*offset];
-            *remaining = 8;
-            --*offset;
-        }
+    if (!device->isSequential() && extractedSize > scratchLimit) {
 
-        if (*remaining > (bits - outbits)) {
-            bitsNow = bits - outbits;
-        } else {
-            bitsNow = *remaining;
+        // big compressed files are decoded a window at a time and written to where they belong in the output,
+        // which is back to front. that needs a device we can seek in, but only keeps the compressed data
+        // (mapped, if we can) and one window in memory instead of the whole thing
+
+        qint64 start = device->pos();
+
+        // allocate the whole file up front so writing the end first doesn't leave it to the filesystem
+
+        if (QFileDevice* out = qobject_cast<QFileDevice*>(device)) {
+            if (out->size() < start + extractedSize && !out->resize(start + extractedSize)) {
+                return false;
+            }
         }
 
-        output <<= bitsNow;
-        output |= static_cast<quint16>(
-                    static_cast<quint16>(
-                        *bitpool >> (*remaining - bitsNow)) & ((1 << bitsNow) - 1));
+        qint64 done = 0;
+
+        bool ok = NaoCRILAYLA::decompress(in, data.size(), ioPolicy().copyBlockSize,
+                                          [&](qint64 at, const uchar* block, qint64 n) {
+            if (!device->seek(start + at) || device->write(reinterpret_cast<const char*>(block), n) != n) {
+                return false;
+            }
+
+            done += n;
+
+            if (progress) {
+                progress(done);
+            }
+
+            return true;
+        });
+
+        return ok && device->seek(start + extractedSize);
+    }
+
+    // everything else is decompressed in memory. extractFiles() passes a buffer that's reused for the whole batch,
+    // so extracting a lot of small entries doesn't allocate for every one of them.
+    // big ones (to a sequential device) get their own so a single one doesn't keep that much memory around
+
+    if (extractedSize > INT_MAX) {
+        return false;
+    }
+
+    QByteArray once;
+    QByteArray& buffer = (scratch && extractedSize <= scratchLimit) ? *scratch : once;
+
+    if (buffer.size() < extractedSize) {
+        buffer.resize(static_cast<int>(extractedSize));
+    }
+
+    if (!NaoCRILAYLA::decompress(in, data.size(), reinterpret_cast<uchar*>(buffer.data()), extractedSize)
+        || device->write(buffer.constData(), extractedSize) != extractedSize) {
+        return false;
+    }
 
-        *remaining -= bitsNow;
-        outbits += bitsNow;
+    if (progress) {
+        progress(extractedSize);
     }
 
-    return output;
+    return true;
 }
 
-QByteArray NaoCRIWareReader::decompressCRILAYLA(QByteArray file) {
-    // ALSO WARNING: ALSO (albeit less so) DIRTY C CODE IN CPP
-    // decompress CRILAYLA (couldn't they just use gzip or something?)
+bool NaoCRIWareReader::extractFiles(const QVector<qint64>& indices, const SinkFactory& sinkFactory,
+                                    const CompletionCallback& completed, int threads, qint64 maxInFlight) {
 
-    quint64 size = file.size();
-    char* data = file.data();
+    // reads stay on this thread and go through the archive front to back, so the disk sees one sequential pass.
+    // stored files are copied right away, compressed ones are read whole and handed to the pool to decompress and write.
+    // those reads go through NaoAsyncIO a few entries ahead, so they're on their way while this thread copies stored
+    // files or waits for room. what compressed data and output buffers (or windows) take is capped at maxInFlight
 
-    if (file.mid(0, 8) != QByteArray("CRILAYLA", 8)) {
-        qFatal("Invalid CRILAYLA signature found");
+    if (threads <= 0) {
+        threads = QThread::idealThreadCount();
     }
 
-    quint32 expectedSize = readUIntLE(&data[8]);
-    quint32 headerOffset = readUIntLE(&data[12]);
+    QVector<qint64> order = indices;
 
-    QByteArray result(expectedSize + 0x100, '\0');
-    char* outdata = result.data();
+    if (_isPak) {
+        std::stable_sort(order.begin(), order.end(), [this](qint64 a, qint64 b) {
+            return (files.at(a).extraOffset + files.at(a).offset) < (files.at(b).extraOffset + files.at(b).offset);
+        });
+    }
 
-    memcpy_s(outdata, 0x100, &data[headerOffset + 0x10], 0x100);
+    QMutex mutex;
+    QWaitCondition released;
+    qint64 inFlight = 0;
+    bool allOk = true;
 
-    quint64 inputEnd = size - 0x101;
-    quint64 inputOffset = inputEnd;
-    quint64 outputEnd = 0xFF + expectedSize;
-    uchar bitpool = 0;
-    quint8 remaining = 0;
-    quint64 outputSize = 0;
-    constexpr quint32 levels[4] = { 2, 3, 5, 8 };
+    auto finish = [&](qint64 index, bool ok, qint64 cost) {
+        if (completed) {
+            completed(index, ok);
+        }
 
-    while (outputSize < expectedSize) {
-        if (getBits(data, &inputOffset, &bitpool, &remaining, 1) > 0) {
-            quint64 backreferenceOffset = outputEnd - outputSize + getBits(data, &inputOffset, &bitpool, &remaining, 13) + 3;
-            quint64 backreferenceLength = 3;
-            quint32 level;
+        QMutexLocker locker(&mutex);
+        inFlight -= cost;
+        allOk = allOk && ok;
+        released.wakeAll();
+    };
 
-            for (level = 0; level < 4; level++) {
-                quint16 thisLevel = getBits(data, &inputOffset, &bitpool, &remaining, levels[level]);
-                backreferenceLength += thisLevel;
+    // a decompression buffer for every job that can run at once, handed out as jobs start and freed once the
+    // batch is done, so nothing stays allocated on the pool's threads afterwards
 
-                if (thisLevel != ((1 << levels[level]) - 1)) {
-                    break;
-                }
+    QVector<QByteArray> scratch(threads);
+    QByteArray* scratchBuffers = scratch.data();
+    QVector<int> idleScratch;
+
+    for (int i = threads - 1; i >= 0; i--) {
+        idleScratch.append(i);
+    }
+
+    // the pool closes the devices it's done with, they're deleted here since they belong to this thread
+
+    QVector<QIODevice*> closed;
+
+    auto deleteClosed = [&] {
+        QVector<QIODevice*> devices;
+
+        {
+            QMutexLocker locker(&mutex);
+            devices.swap(closed);
+        }
+
+        qDeleteAll(devices);
+    };
+
+    QThreadPool pool;
+    pool.setMaxThreadCount(threads);
+
+    auto dispatch = [&](qint64 index, QIODevice* device, const QByteArray& data, qint64 cost) {
+        const qint64 size = files.at(index).size;
+        const qint64 extractedSize = files.at(index).extractedSize;
+
+        pool.start(new NaoBatchJob([=, &finish, &mutex, &idleScratch, &closed] {
+
+            // at most threads jobs run at a time, so there's always one left
+
+            int slot;
+
+            {
+                QMutexLocker locker(&mutex);
+                slot = idleScratch.takeLast();
             }
 
-            if (level == 4) {
-                quint16 thisLevel;
+            bool ok = (data.size() == size) && openForWriting(device)
+                    && _decompressTo(data, extractedSize, device, nullptr, scratchBuffers + slot);
+
+            device->close();
+
+            {
+                QMutexLocker locker(&mutex);
+                idleScratch.append(slot);
+                closed.append(device);
+            }
+
+            finish(index, ok, cost);
+        }));
+    };
+
+    // the compressed entries being read, in the slot their tag says. a mapped archive doesn't need any,
+    // its entries are handed to the pool as views and the pool's page faults are the reads
+
+    struct Read {
+        qint64 index;
+        QIODevice* device;
+        QByteArray data;
+        qint64 filled;
+        qint64 cost;
+    };
+
+    const int depth = isMapped() ? 0 : 8;
 
-                do {
-                    thisLevel = getBits(data, &inputOffset, &bitpool, &remaining, 8);
-                    backreferenceLength += thisLevel;
-                } while (thisLevel == 0xFF);
+    QVector<Read> reads(depth);
+    QVector<int> idleReads;
+
+    for (int i = depth - 1; i >= 0; i--) {
+        idleReads.append(i);
+    }
+
+    // the buffers have to outlive io, which waits for anything still in flight when it goes
+
+    NaoAsyncIO io(this, qMax(depth, 1));
+    QVector<NaoAsyncIO::Completion> completions;
+
+    // hand every entry whose data is in to the pool, waiting for at least one if block is set
+
+    auto land = [&](bool block) {
+        completions.clear();
+
+        if (io.inFlight() == 0 || (block ? io.wait(completions) : io.poll(completions)) <= 0) {
+            return;
+        }
+
+        for (const NaoAsyncIO::Completion& c : completions) {
+            const int slot = static_cast<int>(c.tag);
+            Read& read = reads[slot];
+
+            countAsyncRead(io, c.result);
+
+            // reads may come back short, ask for the rest like copyTo does
+
+            if (c.result > 0) {
+                read.filled += c.result;
+
+                if (read.filled < read.data.size()) {
+                    const EmbeddedFile& file = files.at(read.index);
+
+                    io.submitRead(file.extraOffset + file.offset + read.filled, read.data.size() - read.filled,
+                                  read.data.data() + read.filled, c.tag);
+                    io.submit();
+                    continue;
+                }
+
+                dispatch(read.index, read.device, read.data, read.cost);
+            } else {
+
+                // an error, or the archive ended early
+
+                delete read.device;
+                finish(read.index, false, read.cost);
             }
 
-            for (quint64 i = 0; i < backreferenceLength; i++) {
-                outdata[outputEnd - outputSize] = outdata[backreferenceOffset--];
-                outputSize++;
+            read.data = QByteArray();
+            idleReads.append(slot);
+        }
+    };
+
+    for (qint64 index : order) {
+        deleteClosed();
+        land(false);
+
+        const EmbeddedFile& file = files.at(index);
+        QIODevice* device = sinkFactory(index);
+
+        if (!device) {
+            continue;
+        }
+
+        if (!_isPak || file.size == file.extractedSize) {
+            bool ok = extractFileTo(index, device);
+            delete device;
+
+            finish(index, ok, 0);
+            continue;
+        }
+
+        if (file.size > INT_MAX) {
+            delete device;
+
+            finish(index, false, 0);
+            continue;
+        }
+
+        bool streamed = !device->isSequential() && file.extractedSize > scratchLimit;
+        qint64 cost = file.size + (streamed ? ioPolicy().copyBlockSize + NaoCRILAYLA::maxDistance : file.extractedSize);
+
+        // wait for room (and a free read), but always let one through no matter how big it is.
+        // entries still being read hold room too, so land those rather than wait for the pool
+
+        for (;;) {
+            const bool reading = io.inFlight() > 0;
+
+            if (depth == 0 || !idleReads.isEmpty()) {
+                QMutexLocker locker(&mutex);
+
+                if (inFlight == 0 || inFlight + cost <= maxInFlight) {
+                    inFlight += cost;
+                    break;
+                }
+
+                if (!reading) {
+                    released.wait(&mutex);
+                    continue;
+                }
             }
-        } else {
-            outdata[outputEnd - outputSize] = static_cast<char>(getBits(data, &inputOffset, &bitpool, &remaining, 8));
-            outputSize++;
+
+            land(true);
         }
+
+        if (depth == 0) {
+            dispatch(index, device, viewAt(file.extraOffset + file.offset, file.size), cost);
+            continue;
+        }
+
+        const int slot = idleReads.takeLast();
+        Read& read = reads[slot];
+
+        read.index = index;
+        read.device = device;
+        read.data.resize(static_cast<int>(file.size));
+        read.filled = 0;
+        read.cost = cost;
+
+        countAllocation();
+
+        io.submitRead(file.extraOffset + file.offset, file.size, read.data.data(), static_cast<quint64>(slot));
+        io.submit();
     }
 
-    return result;
+    while (io.inFlight() > 0) {
+        land(true);
+    }
+
+    pool.waitForDone();
+    deleteClosed();
+
+    return allOk;
+}
+
+QByteArray NaoCRIWareReader::decompressCRILAYLA(QByteArray file) {
+    return NaoCRILAYLA::decompress(file);
 }
 
+QByteArray NaoCRIWareReader::compressCRILAYLA(const QByteArray& data, NaoCRILAYLA::Mode mode) {
+    return NaoCRILAYLA::compress(data, mode);
+}
@@ -3,17 +3,67 @@
 
 #include "libnao_global.h"
 #include "NaoFileReader.h"
+#include "NaoCRILAYLA.h"
+#include "NaoText.h"
+#include "NaoPathIndex.h"
 
 #include <QBuffer>
 #include <QVector>
 #include <QVariant>
+#include <QHash>
+
+class NaoIndexCache;
+
+namespace NaoUTF {
+    template <typename Row, typename... Fields>
+    class Schema;
+}
 
 class LIBNAO_API NaoCRIWareReader : public NaoFileReader {
     Q_OBJECT
 
     public:
+    // what to read from a CPK's TOC when opening it, so a few entries of a huge archive don't cost reading all of them.
+    // USM files ignore these
+    struct OpenOptions {
+        enum FilterSyntax {
+            Prefix,     // starts with the filter
+            Glob,       // wildcards, "movie" or "*.usm"
+            RegExp      // QRegularExpression, matches anywhere unless it's anchored. one that isn't valid matches nothing
+        };
+
+        // only entries whose DirName and FileName match are read, an empty filter lets everything through.
+        // the TOC and ETOC are read Lazy, so nothing is decoded up front: each distinct name is decoded and checked
+        // once (most entries share their DirName), the rest of an entry (UserString, LocalDir) only if both match.
+        // ITOC entries have no DirName (and their ID as FileName), dirFilter doesn't apply to them
+        QString dirFilter;
+        QString nameFilter;
+        FilterSyntax syntax = Glob;
+
+        // columns that can be skipped, name, path, offsets and sizes are always read
+        enum Column : quint32 {
+            UserString = 0x01,
+            ID = 0x02,
+            LocalDir = 0x04,        // the ETOC isn't read at all without these two
+            UpdateDateTime = 0x08,
+            AllColumns = 0x0F
+        };
+
+        quint32 columns = AllColumns;
+
+        // opened from (and indexed into) this cache when everything is read, see NaoIndexCache. not owned
+        NaoIndexCache* cache = nullptr;
+
+        bool readsEverything() const {
+            return dirFilter.isEmpty() && nameFilter.isEmpty() && columns == AllColumns;
+        }
+    };
+
     NaoCRIWareReader(QString infile);
     NaoCRIWareReader(QIODevice* device);
+    NaoCRIWareReader(QString infile, const OpenOptions& options);
+    NaoCRIWareReader(QIODevice* device, const OpenOptions& options);
+    ~NaoCRIWareReader();
 
     struct EmbeddedFile {
         QString origin;         // which file table the file was read from
@@ -47,41 +97,18 @@ class LIBNAO_API NaoCRIWareReader : public NaoFileReader {
         quint64 updateDateTime;
     };
 
-    bool isPak() const;
-    const QVector<EmbeddedFile>& getFiles() const;
-
-    QByteArray extractFileAt(qint64 index);
-    bool extractFileTo(qint64 index, QIODevice* device);
-
-    signals:
-    void extractProgress(const qint64 current, const qint64 max);
-
-    private:
-
-    /* USM chunk containing either video or audio stream data/information */
-    struct Chunk {
-        enum Type{
-            Video = 0,
-            Audio
-        } type;
-
-        enum DataType {
-            Data = 0,
-            StreamInfo,
-            StreamMeta,
-            Header
-        } dataType;
-
-        quint32 size;
-        quint16 headerSize;
-        quint16 footerSize;
-
-        qint64 offset;
-    };
-
-    class UTFReader : public NaoFileReader {
+    // parser for the @UTF tables CPK and USM files describe themselves with.
+    // values are stored per column: an array of every column that's stored per row, one value for constant ones
+    class LIBNAO_API UTFReader {
         public:
-        UTFReader(QByteArray packet);
+        enum Decoding {
+            Eager,  // decode every row up front into the columns, for tables that get read more than once
+            Lazy    // keep the packet and decode a cell when it's read, for reading a few cells or a single pass
+        };
+
+        // with Lazy the packet is used as is, if it's a view (NaoFileReader::readView()) it has to stay valid
+        UTFReader(QByteArray packet, Decoding decoding = Eager);
+        ~UTFReader();
 
         struct UTFRow {
             qint32 type;
@@ -97,14 +124,79 @@ class LIBNAO_API NaoCRIWareReader : public NaoFileReader {
             QVariant constVal;
         };
 
+        // everything as QVariant like it used to be, these are built on the first call and are slow
         QVector<UTFField>* getFields() const;
         QVector<QVector<UTFRow>*>* getRows() const;
+
         quint16 getFieldCount() const;
         quint32 getRowCount() const;
         QVariant getFieldData(quint32 row, QString name) const;
         bool hasField(QString name) const;
 
-        private:
+        // a field name with its hash, computed at compile time for literals so looking one up is a single hash probe.
+        // names are hashed as UTF-8, so literals have to be UTF-8 as well. only the reader builds keys from a QString,
+        // since those keep a pointer to it and mustn't outlive the lookup they're made for
+        class Key {
+            public:
+            template <int N>
+            constexpr Key(const char (&name)[N]) :
+                _name(name),
+                _size(N - 1),
+                _hash(hash(name, N - 1)) { }
+
+            // FNV-1a
+            static constexpr quint32 hash(const char* name, int size) {
+                quint32 h = 0x811C9DC5U;
+
+                for (int i = 0; i < size; i++) {
+                    h = (h ^ static_cast<uchar>(name[i])) * 0x01000193U;
+                }
+
+                return h;
+            }
+
+            constexpr quint32 hash() const {
+                return _hash;
+            }
+
+            bool matches(const QString& name) const;
+
+            private:
+            friend class UTFReader;
+
+            Key(const QString& name);
+
+            const char* _name = nullptr;
+            int _size = 0;
+            const QString* _string = nullptr;
+            quint32 _hash;
+        };
+
+        // index of the column called key, -1 if there's none. it stays the same for the life of the reader,
+        // so resolve it once and use the typed accessors with it
+        int column(Key key) const;
+        int column(const QString& name) const;
+
+        template <int N>
+        int column(const char (&name)[N]) const {
+            return column(Key(name));
+        }
+
+        // columns without a const or row value (and those that don't exist) have nothing to read
+        bool hasValue(int column) const;
+        quint32 typeOf(int column) const;
+
+        // typed access without going through QVariant, 0 or empty if there's no value.
+        // the integer accessors take any integer column, floats are converted
+        quint64 u64At(int column, quint32 row) const;
+        qint64 s64At(int column, quint32 row) const;
+        double doubleAt(int column, quint32 row) const;
+        QString stringAt(int column, quint32 row) const;
+
+        // identifies the string in a cell without decoding it: cells of one column with the same key hold the same string
+        quint32 stringKeyAt(int column, quint32 row) const;
+        QByteArray dataAt(int column, quint32 row) const;
+
         enum StorageFlags : quint32 {
             HasName = 0x10,
             ConstVal = 0x20,
@@ -126,29 +218,192 @@ class LIBNAO_API NaoCRIWareReader : public NaoFileReader {
             Data = 0x0B
         };
 
+        private:
+        Q_DISABLE_COPY(UTFReader)
+
+        // reads the rows directly once it's checked the columns, see NaoUTFSchema.h
+        template <typename Row, typename... Fields>
+        friend class NaoUTF::Schema;
+
+        struct Column {
+            QString name;
+            quint8 flags;
+            quint32 nameOffset;
+            int width;              // bytes per value, 0 for unknown types
+            int rowOffset;          // where it is inside a row, RowVal columns only
+            quint64 constVal;       // integers and float bits as is, string pool ids, data offset << 32 | size
+            QByteArray values;      // RowVal columns: getRowCount() values of width bytes in host order, like constVal
+        };
+
+        quint64 _raw(const Column& column, quint32 row) const;
+        quint32 _intern(quint32 offset);
+        QString _decodeString(quint32 offset) const;
+        QString _lazyString(quint32 offset) const;
+        QByteArray _dataAt(quint64 v) const;
+        QVariant _variant(int column, quint32 row) const;
+
+        Decoding _decoding;
+
         uchar _encodeType;
         quint16 fieldCount;
         quint32 rowCount;
 
-        QVector<UTFField>* _fields;
-        QVector<QVector<UTFRow>*>* _rows;
+        // Lazy only: the packet and its rows
+        QByteArray _packet;
+        const uchar* _rowData = nullptr;
+        quint16 _rowSize;
+
+        QVector<Column> _columns;
+        QHash<quint32, int> _columnsByHash;    // first column for each name hash
+
+        // strings and data areas (the end of the packet, a slice of _packet with Lazy) and where they start
+        QByteArray _tail;
+        quint32 _stringsOffset;
+        quint32 _dataOffset;
+
+        NaoText::Encoding _encoding;
+
+        // Eager: every string in the table decoded once, and which one starts at each offset.
+        // Lazy only has the const values in here
+        QVector<QString> _strings;
+        QHash<quint32, quint32> _stringIds;
+
+        // Lazy: the strings read so far by offset, which makes reading cells of a Lazy table not thread-safe
+        mutable QHash<quint32, QString> _lazyStrings;
+
+        mutable QVector<UTFField>* _fields = nullptr;
+        mutable QVector<QVector<UTFRow>*>* _rows = nullptr;
     };
 
+    bool isPak() const;
+    const QVector<EmbeddedFile>& getFiles() const;
+
+    // index into getFiles() of the entry with this ID (TOC or ITOC ID, USM stream ID), -1 if there's none.
+    // constant time. the first entry wins if IDs repeat, and TOC entries aren't found if OpenOptions left the ID out
+    qint64 findById(quint32 id) const;
+
+    // index into getFiles() of the entry at path ("DirName/FileName"), -1 if there's none. constant time
+    qint64 findByPath(const QString& path) const;
+
+    // every entry by path and the directories they're in, built when the file is opened
+    const NaoPathIndex& pathIndex() const;
+
+    // the GTOC as is, which groups entries for the game's loader, nullptr if the archive doesn't have one
+    const UTFReader* gtoc() const;
+
+    // a row of the GTOC's Gdata table. groups form a tree: child is the row of the first subgroup and next the row
+    // of the following sibling, both as the GTOC stores them
+    struct Group {
+        QString name;
+        qint64 child;
+        qint64 next;
+    };
+
+    // a row of the GTOC's Attrdata table: the alignment a group of files is stored with, how many and how big they are
+    struct GroupAttribute {
+        QString name;
+        quint32 align;
+        quint32 files;
+        quint64 size;
+    };
+
+    // both empty if the archive doesn't have a GTOC. which file is in which group (Fdata) is only in gtoc()
+    const QVector<Group>& groups() const;
+    const QVector<GroupAttribute>& groupAttributes() const;
+
+    // extraction only uses positional reads, these may be called from multiple threads at once
+    QByteArray extractFileAt(qint64 index);
+    QByteArray viewFileAt(qint64 index);    // no copy for stored files if mapped, only valid while the reader lives
+    bool extractFileTo(qint64 index, QIODevice* device);    // big compressed files are decoded in windows if device is seekable
+
+    // where extractFiles() writes an entry to, nullptr skips it. extractFiles() takes the device: it's closed once
+    // the entry is done and deleted on the calling thread, so it mustn't have a parent
+    typedef std::function<QIODevice*(qint64 index)> SinkFactory;
+
+    // called once per entry when it's done (its device closed), from whichever thread finished it (so maybe several at once)
+    typedef std::function<void(qint64 index, bool ok)> CompletionCallback;
+
+    // extract many entries at once: the archive is read front to back on the calling thread and compressed entries
+    // are decompressed and written on threads threads (0 for one per core). at most maxInFlight bytes of compressed
+    // data and output buffers are held at a time. returns whether every entry was extracted
+    bool extractFiles(const QVector<qint64>& indices, const SinkFactory& sinkFactory,
+                      const CompletionCallback& completed = nullptr, int threads = 0, qint64 maxInFlight = 0x10000000);
+
+    // extract into memory the caller owns (a reused buffer, a mapped output file), dst needs room for extractedSize bytes
+    bool extractFileInto(qint64 index, char* dst, qint64 capacity);
+
+    // decompress a complete CRILAYLA blob (header, bitstream and uncompressed 0x100 byte prefix), empty if it's corrupt
+    static QByteArray decompressCRILAYLA(QByteArray file);
+
+    // compress data (at least 0x100 bytes) into a CRILAYLA blob for repacking, see NaoCRILAYLA::compress
+    static QByteArray compressCRILAYLA(const QByteArray& data, NaoCRILAYLA::Mode mode = NaoCRILAYLA::Greedy);
+
+    signals:
+    void extractProgress(const qint64 current, const qint64 max);
+
+    private:
+    friend class NaoIndexCache;
+
+    /* USM chunk containing either video or audio stream data/information */
+    struct Chunk {
+        enum Type{
+            Video = 0,
+            Audio
+        } type;
+
+        enum DataType {
+            Data = 0,
+            StreamInfo,
+            StreamMeta,
+            Header
+        } dataType;
+
+        quint32 size;
+        quint16 headerSize;
+        quint16 footerSize;
+
+        qint64 offset;
+    };
+
+    OpenOptions _options;
+
     bool _isPak;
 
     qint64 _cpkOffset;
     UTFReader* _cpkUTF = nullptr;
+    UTFReader* _gtocUTF = nullptr;
+    qint64 _gtocOffset = 0;
+    QVector<Group> _groups;
+    QVector<GroupAttribute> _groupAttributes;
 
     QVector<EmbeddedFile> files;
 
+    // entry for every ID: indexed by ID if they're dense enough (0 .. n - 1 usually), hashed if not
+    QVector<qint64> _denseIds;
+    QHash<quint32, qint64> _sparseIds;
+
+    NaoPathIndex _paths;
+
     QVector<Chunk> dataChunks;
 
     void startup();
-    QByteArray readNextUTF();
 
-    QByteArray decompressCRILAYLA(QByteArray file);
+    // the TOC entries that pass the open options, rows gets the TOC row of each
+    void _readFilteredTOC(const UTFReader& toc, qint64 extraOffset, QVector<quint32>& rows);
 
-    static quint16 getBits(char* input, quint64* offset, uchar* bitpool, quint8* remaining, quint64 bits);
+    // entries that are only addressed by ID, stored one after the other (aligned) in ID order from contentOffset
+    void _readITOC(const UTFReader& itoc, qint64 contentOffset, qint64 align);
+    void _readGTOC();
+
+    void _indexIds();
+    void _indexPaths();
+
+    // decompress the CRILAYLA entry in data to device: in windows if it's big and device is seekable, in memory otherwise.
+    // in memory goes through scratch if there is one (and it's not too big), so a batch can reuse its buffers
+    bool _decompressTo(const QByteArray& data, qint64 extractedSize, QIODevice* device,
+                       const std::function<void(qint64)>& progress, QByteArray* scratch = nullptr) const;
+
+    QByteArray readNextUTF();
 };
 
 #endif // NAOCRIWAREREADER_H
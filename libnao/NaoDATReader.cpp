@@ -1,6 +1,5 @@
 #include "NaoDATReader.h"
-
-#include <windows.h>
+#include "NaoIndexCache.h"
 
 NaoDATReader::NaoDATReader(QString infile):
     NaoFileReader(infile),
@@ -8,6 +7,13 @@ NaoDATReader::NaoDATReader(QString infile):
     startup();
 }
 
+NaoDATReader::NaoDATReader(QString infile, const OpenOptions& options) :
+    NaoFileReader(infile),
+    fname(infile),
+    _options(options) {
+    startup();
+}
+
 NaoDATReader::NaoDATReader(QIODevice *device, QString fname) :
     NaoFileReader(device),
     fname(fname) {
@@ -19,6 +25,20 @@ void NaoDATReader::startup() {
         qFatal("Invalid DAT fourCC found");
     }
 
+    if (_options.cache) {
+        beginPhase("cache");
+
+        const bool cached = _options.cache->load(*this);
+
+        endPhase();
+
+        if (cached) {
+            return;
+        }
+    }
+
+    beginPhase("header");
+
     // skip fourCC
 
     seekRel(4);
@@ -33,6 +53,9 @@ void NaoDATReader::startup() {
     quint32 namesOffset = readUIntLE();
     quint32 sizesOffset = readUIntLE();
 
+    endPhase();
+    beginPhase("names");
+
     seek(namesOffset);
 
     // names table is prepended with an uint that specifies the alignment of the names
@@ -49,79 +72,88 @@ void NaoDATReader::startup() {
         files[i].name = QString(read(namesAlignment));
     }
 
-    seek(filesOffset);
+    endPhase();
+    beginPhase("tables");
+
+    // offsets and sizes are plain uint tables, so read them in bulk
+
+    QVector<quint32> table(fileCount);
 
-    // offsets
+    seek(filesOffset);
+    readArray<quint32, NaoEndian::Little>(fileCount, table.data());
 
     for (quint32 i = 0; i < fileCount; ++i) {
-        files[i].offset = readUIntLE();
+        files[i].offset = table[i];
     }
 
     seek(sizesOffset);
-
-    // sizes
+    readArray<quint32, NaoEndian::Little>(fileCount, table.data());
 
     for (quint32 i = 0; i < fileCount; ++i) {
-        files[i].size = readUIntLE();
+        files[i].size = table[i];
     }
-}
 
-bool NaoDATReader::extractFileTo(qint64 index, QIODevice *device) {
-    // extract to a QIODevice
+    endPhase();
 
-    if (!device->isWritable()) {
-        device->open(QIODevice::WriteOnly);
+    _indexPaths();
 
-        if (!device->isWritable()) {
-            return false;
-        }
-    }
+    if (_options.cache) {
+        beginPhase("cache");
 
-    EmbeddedFile file = files.at(index);
+        _options.cache->store(*this);
 
-    // get the size of the blocks in which we'll be extracting
+        endPhase();
+    }
+}
 
-    SYSTEM_INFO inf;
-    GetNativeSystemInfo(&inf);
-    const quint32 targetBlockSize = inf.dwPageSize;
+void NaoDATReader::_indexPaths() {
 
-    seek(file.offset);
+    // names are all there is to a path here, DATs don't have directories
 
-    qint64 remaining = file.size;
-    qint64 done = 0;
+    QVector<QString> paths;
+    paths.reserve(files.size());
 
-    emit setExtractMaximum(remaining);
+    for (const EmbeddedFile& file : files) {
+        paths.append(file.name);
+    }
 
-    // read targetBlockSize bytes untill we can read no more
+    _paths = NaoPathIndex(paths);
+}
 
-    while (remaining >= targetBlockSize) {
-        device->write(read(targetBlockSize));
+bool NaoDATReader::extractFileTo(qint64 index, QIODevice *device) {
+    // extract to a QIODevice, only positional reads so multiple threads may extract (to different devices) at once
 
-        remaining-= targetBlockSize;
-        done += targetBlockSize;
+    if (!device->isWritable()) {
+        device->open(QIODevice::WriteOnly);
 
-        if (done % (targetBlockSize * 32) == 0) {
-            emit extractProgress(done);
+        if (!device->isWritable()) {
+            return false;
         }
     }
 
-    // read the remaining
+    const EmbeddedFile& file = files.at(index);
 
-    if (remaining > 0) {
-        device->write(read(remaining));
+    emit setExtractMaximum(file.size);
 
-        done += remaining;
+    // copy a block at a time (see ioPolicy()), reading ahead while we write
 
+    return copyTo(device, file.offset, file.size, [&](qint64 done) {
         emit extractProgress(done);
-    }
-
-    return true;
+    });
 }
 
 const QVector<NaoDATReader::EmbeddedFile>& NaoDATReader::getFiles() const {
     return files;
 }
 
+qint64 NaoDATReader::findByPath(const QString& path) const {
+    return _paths.find(path);
+}
+
+const NaoPathIndex& NaoDATReader::pathIndex() const {
+    return _paths;
+}
+
 QString NaoDATReader::getFileName() const {
     return fname;
 }
@@ -3,14 +3,24 @@
 
 #include "libnao_global.h"
 #include "NaoFileReader.h"
+#include "NaoPathIndex.h"
 
 #include <QVector>
 
+class NaoIndexCache;
+
 class LIBNAO_API NaoDATReader : public NaoFileReader {
     Q_OBJECT
 
     public:
+    struct OpenOptions {
+
+        // opened from (and indexed into) this cache, see NaoIndexCache. not owned
+        NaoIndexCache* cache = nullptr;
+    };
+
     NaoDATReader(QString infile);
+    NaoDATReader(QString infile, const OpenOptions& options);
     NaoDATReader(QIODevice* device, QString fname = QString());
 
     struct EmbeddedFile {
@@ -20,19 +30,29 @@ class LIBNAO_API NaoDATReader : public NaoFileReader {
     };
 
     const QVector<EmbeddedFile>& getFiles() const;
+
+    // index into getFiles() of the entry called path, -1 if there's none. constant time
+    qint64 findByPath(const QString& path) const;
+    const NaoPathIndex& pathIndex() const;
+
     QString getFileName() const;
 
-    bool extractFileTo(qint64 index, QIODevice* device);
+    bool extractFileTo(qint64 index, QIODevice* device);   // thread-safe, uses positional reads only
 
     signals:
     void extractProgress(const qint64 current);
     void setExtractMaximum(const qint64 max);
 
     private:
+    friend class NaoIndexCache;
+
     void startup();
+    void _indexPaths();
 
     QString fname;
+    OpenOptions _options;
     QVector<EmbeddedFile> files;
+    NaoPathIndex _paths;
 };
 
 #endif // NAODATREADER_H
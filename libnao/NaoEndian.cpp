@@ -0,0 +1,153 @@
+#include "NaoEndian.h"
+
+// pshufb kernels for x86, picked at runtime so we don't need any special compiler flags
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define NAO_SIMD_X86
+#define NAO_TARGET(t) __attribute__((target(t)))
+
+#include <immintrin.h>
+
+static bool hasSSSE3() {
+    return __builtin_cpu_supports("ssse3");
+}
+
+static bool hasAVX2() {
+    return __builtin_cpu_supports("avx2");
+}
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#define NAO_SIMD_X86
+#define NAO_TARGET(t)
+
+#include <intrin.h>
+#include <immintrin.h>
+
+static bool hasSSSE3() {
+    int info[4];
+    __cpuid(info, 1);
+
+    return (info[2] & (1 << 9)) != 0;
+}
+
+static bool hasAVX2() {
+    int info[4];
+    __cpuid(info, 1);
+
+    // AVX2 needs the OS to save the ymm registers as well
+
+    if ((info[2] & (1 << 27)) == 0 || (_xgetbv(0) & 6) != 6) {
+        return false;
+    }
+
+    __cpuidex(info, 7, 0);
+
+    return (info[1] & (1 << 5)) != 0;
+}
+#endif
+
+template <typename T>
+static void bswapScalar(uchar* data, qint64 count) {
+    for (qint64 i = 0; i < count; ++i) {
+        T v;
+        memcpy(&v, data + i * sizeof(T), sizeof(T));
+        v = NaoBytes::bswap(v);
+        memcpy(data + i * sizeof(T), &v, sizeof(T));
+    }
+}
+
+#ifdef NAO_SIMD_X86
+
+// shuffle masks reversing every 2, 4 or 8 byte element in a 16 byte lane
+
+static const char* shuffleMask(int width) {
+    alignas(16) static const char masks[3][16] = {
+        { 1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14 },
+        { 3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12 },
+        { 7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8 }
+    };
+
+    return masks[(width == 2) ? 0 : (width == 4) ? 1 : 2];
+}
+
+// both return the number of bytes they processed, the tail is left for the scalar loop
+
+NAO_TARGET("ssse3")
+static qint64 bswapSSSE3(uchar* data, qint64 bytes, int width) {
+    const __m128i mask = _mm_load_si128(reinterpret_cast<const __m128i*>(shuffleMask(width)));
+
+    qint64 i = 0;
+
+    for (; i + 16 <= bytes; i += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(data + i), _mm_shuffle_epi8(v, mask));
+    }
+
+    return i;
+}
+
+NAO_TARGET("avx2")
+static qint64 bswapAVX2(uchar* data, qint64 bytes, int width) {
+
+    // vpshufb works per 128 bit lane, so the same mask goes in both halves
+
+    const __m128i half = _mm_load_si128(reinterpret_cast<const __m128i*>(shuffleMask(width)));
+    const __m256i mask = _mm256_broadcastsi128_si256(half);
+
+    qint64 i = 0;
+
+    for (; i + 64 <= bytes; i += 64) {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+        __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i + 32));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(data + i), _mm256_shuffle_epi8(a, mask));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(data + i + 32), _mm256_shuffle_epi8(b, mask));
+    }
+
+    for (; i + 32 <= bytes; i += 32) {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(data + i), _mm256_shuffle_epi8(a, mask));
+    }
+
+    return i;
+}
+#endif
+
+void NaoBytes::bswapArray(void* data, qint64 count, int width) {
+    uchar* bytes = static_cast<uchar*>(data);
+    qint64 total = count * width;
+    qint64 done = 0;
+
+    if (width != 2 && width != 4 && width != 8) {
+        return;
+    }
+
+#ifdef NAO_SIMD_X86
+    static const bool avx2 = hasAVX2();
+    static const bool ssse3 = hasSSSE3();
+
+    if (avx2) {
+        done = bswapAVX2(bytes, total, width);
+    }
+
+    if (ssse3) {
+        done += bswapSSSE3(bytes + done, total - done, width);
+    }
+#endif
+
+    // whatever is left over (or everything, without SIMD)
+
+    qint64 rest = (total - done) / width;
+
+    switch (width) {
+        case 2:
+            bswapScalar<quint16>(bytes + done, rest);
+            break;
+
+        case 4:
+            bswapScalar<quint32>(bytes + done, rest);
+            break;
+
+        case 8:
+            bswapScalar<quint64>(bytes + done, rest);
+            break;
+    }
+}
@@ -0,0 +1,113 @@
+#ifndef NAOENDIAN_H
+#define NAOENDIAN_H
+
+#include "libnao_global.h"
+
+#include <cstring>
+#include <type_traits>
+
+#ifdef _MSC_VER
+#include <stdlib.h>
+#endif
+
+enum class NaoEndian {
+    Little,
+    Big,
+
+#if Q_BYTE_ORDER == Q_LITTLE_ENDIAN
+    Host = Little
+#else
+    Host = Big
+#endif
+};
+
+namespace NaoBytes {
+    template <size_t N> struct UInt { };
+    template <> struct UInt<1> { typedef quint8 type; };
+    template <> struct UInt<2> { typedef quint16 type; };
+    template <> struct UInt<4> { typedef quint32 type; };
+    template <> struct UInt<8> { typedef quint64 type; };
+
+    // byte swap an unsigned integer, these compile down to a single bswap/rol
+
+    template <typename T>
+    inline T bswap(T v) {
+        static_assert(std::is_unsigned<T>::value, "bswap needs an unsigned type");
+
+        if constexpr (sizeof(T) == 1) {
+            return v;
+        } else if constexpr (sizeof(T) == 2) {
+#ifdef _MSC_VER
+            return _byteswap_ushort(v);
+#else
+            return __builtin_bswap16(v);
+#endif
+        } else if constexpr (sizeof(T) == 4) {
+#ifdef _MSC_VER
+            return _byteswap_ulong(v);
+#else
+            return __builtin_bswap32(v);
+#endif
+        } else {
+#ifdef _MSC_VER
+            return _byteswap_uint64(v);
+#else
+            return __builtin_bswap64(v);
+#endif
+        }
+    }
+
+    // load a T stored with endianness E from possibly unaligned memory
+
+    template <typename T, NaoEndian E>
+    inline T load(const void* src) {
+        static_assert(std::is_arithmetic<T>::value, "can only load arithmetic types");
+
+        typedef typename UInt<sizeof(T)>::type U;
+
+        U u;
+        memcpy(&u, src, sizeof(T));
+
+        if constexpr (E != NaoEndian::Host) {
+            u = bswap(u);
+        }
+
+        T v;
+        memcpy(&v, &u, sizeof(T));
+
+        return v;
+    }
+
+    // and the other way around
+
+    template <typename T, NaoEndian E>
+    inline void store(T v, void* dst) {
+        static_assert(std::is_arithmetic<T>::value, "can only store arithmetic types");
+
+        typedef typename UInt<sizeof(T)>::type U;
+
+        U u;
+        memcpy(&u, &v, sizeof(T));
+
+        if constexpr (E != NaoEndian::Host) {
+            u = bswap(u);
+        }
+
+        memcpy(dst, &u, sizeof(T));
+    }
+
+    // in-place byte swap of count elements of width bytes each (2, 4 or 8), vectorised where possible
+    LIBNAO_API void bswapArray(void* data, qint64 count, int width);
+
+    // convert an array stored with endianness E to host order in-place
+    template <typename T, NaoEndian E>
+    inline void toHost(T* data, qint64 count) {
+        static_assert(std::is_arithmetic<T>::value, "can only convert arithmetic types");
+
+        if constexpr (E != NaoEndian::Host && sizeof(T) > 1) {
+            bswapArray(data, count, sizeof(T));
+        }
+    }
+}
+
+#endif // NAOENDIAN_H
@@ -1,14 +1,40 @@
 #include "NaoFileReader.h"
+#include "NaoAsyncIO.h"
 
-// I quoteth "REINTERPRET_CAST SHOULD BE USED WITH CAUTION"
+#include <QMutexLocker>
+#include <QElapsedTimer>
 
-// it's safe to assume this code runs on little-endian systems,
-// so we can just reinterpret_cast char pointers as integer pointers of the appropiate type for LE conversions
+#ifdef Q_OS_UNIX
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <cerrno>
+#include <cstdlib>
+#endif
+
+#ifdef Q_OS_WIN
+#include <qt_windows.h>
+#endif
 
 NaoFileReader::NaoFileReader(QString infile) :
     _filename(infile),
-    _infile(new QFile(infile)) {
-    _infile->open(QIODevice::ReadOnly);
+    _infile(new QFile(infile, this)) {
+    QFile* file = static_cast<QFile*>(_infile);
+    file->open(QIODevice::ReadOnly);
+
+    // map the whole file so we never have to go through QIODevice::read for small reads,
+    // if this fails (empty file, out of address space) we just fall back to the buffer
+
+    _fd = file->handle();
+
+    if (file->size() > 0) {
+        _map = file->map(0, file->size());
+
+        if (_map) {
+            _window = _map;
+            _windowSize = file->size();
+        }
+    }
 
     _NaoFileReaderStartup();
 }
@@ -19,369 +45,992 @@ NaoFileReader::NaoFileReader(QIODevice *device, QString filename) :
     if (!_infile->isReadable())
         _infile->open(QIODevice::ReadOnly);
 
+    // files we can read positionally without going through the device
+
+    QFileDevice* file = qobject_cast<QFileDevice*>(_infile);
+
+    if (file) {
+        _fd = file->handle();
+    }
+
+    // start wherever the device currently is
+
+    _pos = _infile->pos();
+    _windowStart = _pos;
+
     _NaoFileReaderStartup();
 }
 
 void NaoFileReader::_NaoFileReaderStartup() {
     // read + store fourCC, then seek back to the start
 
-    _fourCC = QString::fromLatin1(_infile->read(4).append('\0'));
+    char fourCC[5] = { 0 };
+    _readInto(fourCC, 4);
+
+    _fourCC = QString::fromLatin1(fourCC);
     seekRel(-4);
 }
 
+qint64 NaoFileReader::_readInto(void* dst, qint64 n) {
+    char* out = static_cast<char*>(dst);
+    qint64 got = 0;
+
+    while (got < n) {
+
+        // take whatever the window has at our position
+
+        if (_pos >= _windowStart && _pos < _windowStart + _windowSize) {
+            qint64 count = qMin(n - got, _windowStart + _windowSize - _pos);
+            memcpy(out + got, _window + (_pos - _windowStart), count);
+
+            if (_map) {
+                _bytesRead.fetchAndAddRelaxed(count);
+            }
+
+            _pos += count;
+            got += count;
+
+            continue;
+        }
+
+        if (_map) {
+            break;
+        }
+
+        // big reads go straight to the device, anything else refills the buffer
+
+        if (n - got >= _bufferSize && !_infile->isSequential()) {
+            qint64 count = _deviceReadAt(_pos, out + got, n - got);
+
+            if (count <= 0) {
+                break;
+            }
+
+            _pos += count;
+            got += count;
+        } else if (!_fill()) {
+            break;
+        }
+    }
+
+    // short reads leave zeroes behind instead of garbage
+
+    if (got < n) {
+        memset(out + got, 0, n - got);
+    }
+
+    return got;
+}
+
+qint64 NaoFileReader::_deviceReadAt(qint64 offset, char* dst, qint64 n) const {
+    QElapsedTimer timer;
+    timer.start();
+
+    _deviceReads.fetchAndAddRelaxed(1);
+
+#ifdef Q_OS_UNIX
+
+    // pread doesn't care about (or change) the file position, so no locking needed
+
+    if (_fd >= 0) {
+        qint64 got = 0;
+
+        while (got < n) {
+            ssize_t count = ::pread(_fd, dst + got, n - got, offset + got);
+
+            if (count <= 0) {
+                break;
+            }
+
+            got += count;
+        }
+
+        _bytesRead.fetchAndAddRelaxed(got);
+        _ioNanoseconds.fetchAndAddRelaxed(timer.nsecsElapsed());
+
+        return got;
+    }
+#endif
+
+    QMutexLocker lock(&_deviceLock);
+
+    if (_infile->pos() != offset && !_infile->seek(offset)) {
+        return -1;
+    }
+
+    qint64 got = _infile->read(dst, n);
+
+    _bytesRead.fetchAndAddRelaxed(qMax<qint64>(got, 0));
+    _ioNanoseconds.fetchAndAddRelaxed(timer.nsecsElapsed());
+
+    return got;
+}
+
+qint64 NaoFileReader::_deviceRead(char* dst, qint64 n) {
+
+    // plain read for sequential devices, the caller holds the lock
+
+    QElapsedTimer timer;
+    timer.start();
+
+    qint64 got = _infile->read(dst, n);
+
+    _deviceReads.fetchAndAddRelaxed(1);
+    _bytesRead.fetchAndAddRelaxed(qMax<qint64>(got, 0));
+    _ioNanoseconds.fetchAndAddRelaxed(timer.nsecsElapsed());
+
+    return got;
+}
+
+bool NaoFileReader::_fill() {
+    if (_buffer.size() != _bufferSize) {
+        _allocations.fetchAndAddRelaxed(1);
+    }
+
+    if (_infile->isSequential()) {
+        QMutexLocker lock(&_deviceLock);
+
+        // we can't seek, so skip forward by reading (the device is always at the end of the window)
+
+        qint64 devicePos = _windowStart + _windowSize;
+
+        if (_pos < devicePos) {
+            return false;
+        }
+
+        while (devicePos < _pos) {
+            _buffer.resize(_bufferSize);
+            qint64 count = _deviceRead(_buffer.data(), qMin(_bufferSize, _pos - devicePos));
+
+            if (count <= 0) {
+                _windowStart = devicePos;
+                _windowSize = 0;
+
+                return false;
+            }
+
+            devicePos += count;
+        }
+
+        _buffer.resize(_bufferSize);
+        _windowSize = qMax<qint64>(0, _deviceRead(_buffer.data(), _bufferSize));
+    } else {
+        _buffer.resize(_bufferSize);
+        _windowSize = qMax<qint64>(0, _deviceReadAt(_pos, _buffer.data(), _bufferSize));
+    }
+
+    _window = reinterpret_cast<const uchar*>(_buffer.constData());
+    _windowStart = _pos;
+
+    return _windowSize > 0;
+}
+
 QString NaoFileReader::fourCC() const {
     return _fourCC;
 }
 
 qint64 NaoFileReader::pos() const {
-    return _infile->pos();
+    return _pos;
 }
 
-QByteArray NaoFileReader::read(qint64 n) {
-    return _infile->read(n);
+qint64 NaoFileReader::size() const {
+    return _map ? _windowSize : _infile->size();
 }
 
-bool NaoFileReader::seekRel(qint64 p) {
-    return _infile->seek(_infile->pos() + p);
-}
+bool NaoFileReader::atEnd() const {
+    if (_map || !_infile->isSequential()) {
+        return _pos >= size();
+    }
 
-bool NaoFileReader::seek(qint64 p) {
-    return _infile->seek(p);
+    return _pos >= _windowStart + _windowSize && _infile->atEnd();
 }
 
-quint8 NaoFileReader::readUChar() {
-    return *reinterpret_cast<uchar*>(read(1).data());
+bool NaoFileReader::isMapped() const {
+    return _map != nullptr;
 }
 
-qint8 NaoFileReader::readChar() {
-    return *read(1);
+int NaoFileReader::nativeHandle() const {
+    return _fd;
 }
 
-quint16 NaoFileReader::readUShortLE() {
-    return *reinterpret_cast<quint16*>(read(2).data());
+qint64 NaoFileReader::bufferSize() const {
+    return _bufferSize;
 }
 
-quint16 NaoFileReader::readUShortBE() {
-    QByteArray r = read(2);
-    quint16 v = 0;
+void NaoFileReader::setBufferSize(qint64 size) {
+    _bufferSize = qMax<qint64>(size, 16);
+}
 
-    for (int i = 0; i < 2; i++) {
-        v <<= 8;
-        v |= (r.at(i) & 0xFF); // Sometimes the upper bits get a nonzero value, so we extract the lower bits like this
-    }
+NaoFileReader::IOPolicy NaoFileReader::ioPolicy() const {
+    return _ioPolicy;
+}
 
-    return v;
+void NaoFileReader::setIOPolicy(const IOPolicy& policy) {
+    _ioPolicy = policy;
+    _ioPolicy.copyBlockSize = qMax<qint64>(policy.copyBlockSize, 0x1000);
 }
 
-quint16 NaoFileReader::readUShortLE(char b[2]) {
-    return *reinterpret_cast<quint16*>(b);
+qint64 NaoFileReader::pageSize() {
+    static const qint64 size = [] {
+#if defined(Q_OS_UNIX)
+        return static_cast<qint64>(sysconf(_SC_PAGESIZE));
+#elif defined(Q_OS_WIN)
+        SYSTEM_INFO info;
+        GetNativeSystemInfo(&info);
+
+        return static_cast<qint64>(info.dwPageSize);
+#else
+        return qint64(0x1000);
+#endif
+    }();
+
+    return size;
 }
 
-quint16 NaoFileReader::readUShortLE(uchar b[2]) {
-    return *reinterpret_cast<quint16*>(b);
+QByteArray NaoFileReader::read(qint64 n) {
+    _allocations.fetchAndAddRelaxed(1);
+
+    QByteArray r(static_cast<int>(qMax<qint64>(n, 0)), '\0');
+    r.resize(_readInto(r.data(), r.size()));
+
+    return r;
 }
 
-quint16 NaoFileReader::readUShortBE(char b[2]) {
-    return readUShortBE(reinterpret_cast<uchar*>(b));
+QByteArray NaoFileReader::readView(qint64 n) {
+    if (_map) {
+        qint64 got = qBound<qint64>(0, _windowSize - _pos, n);
+        QByteArray view = QByteArray::fromRawData(reinterpret_cast<const char*>(_map + _pos), got);
+        _pos += got;
+
+        _bytesRead.fetchAndAddRelaxed(got);
+
+        return view;
+    }
+
+    return read(n);
 }
 
-quint16 NaoFileReader::readUShortBE(uchar b[2]) {
-    quint16 v = 0;
+qint64 NaoFileReader::readAt(qint64 offset, qint64 n, char* dst) const {
+    if (offset < 0 || n < 0) {
+        return -1;
+    }
+
+    if (_map) {
+        qint64 got = qBound<qint64>(0, _windowSize - offset, n);
+        memcpy(dst, _map + offset, got);
 
-    for (int i = 0; i < 2; i++) {
-        v <<= 8;
-        v |= b[i];
+        _bytesRead.fetchAndAddRelaxed(got);
+
+        return got;
     }
 
-    return v;
+    // there's no going back on a sequential device
+
+    if (_infile->isSequential()) {
+        return -1;
+    }
+
+    return _deviceReadAt(offset, dst, n);
 }
 
-qint16 NaoFileReader::readShortLE() {
-    return *reinterpret_cast<qint16*>(read(2).data());
+QByteArray NaoFileReader::readAt(qint64 offset, qint64 n) const {
+    _allocations.fetchAndAddRelaxed(1);
+
+    QByteArray r(static_cast<int>(qMax<qint64>(n, 0)), '\0');
+    r.resize(static_cast<int>(qMax<qint64>(readAt(offset, r.size(), r.data()), 0)));
+
+    return r;
 }
 
-qint16 NaoFileReader::readShortBE() {
-    QByteArray r = read(2);
-    qint16 v = 0;
+QByteArray NaoFileReader::viewAt(qint64 offset, qint64 n) const {
+    if (_map) {
+        qint64 got = (offset < 0) ? 0 : qBound<qint64>(0, _windowSize - offset, n);
+
+        _bytesRead.fetchAndAddRelaxed(got);
 
-    for (int i = 0; i < 2; i++) {
-        v <<= 8;
-        v |= (r.at(i) & 0xFF);
+        return QByteArray::fromRawData(reinterpret_cast<const char*>(_map + offset), got);
     }
 
-    return v;
+    return readAt(offset, n);
 }
 
-qint16 NaoFileReader::readShortLE(char b[2]) {
-    return *reinterpret_cast<qint16*>(b);
-}
+bool NaoFileReader::copyTo(QIODevice* device, qint64 offset, qint64 size,
+                           const std::function<void(qint64)>& progress) const {
+    if (size <= 0) {
+        return size == 0;
+    }
+
+    const qint64 blockSize = _ioPolicy.copyBlockSize;
+
+    // big copies can skip the page cache altogether, if the file system lets us
+
+    if (_ioPolicy.directThreshold > 0 && size >= _ioPolicy.directThreshold) {
+        CopyResult result = _copyDirect(device, offset, size, progress);
+
+        if (result != Unsupported) {
+            return result == Copied;
+        }
+    }
+
+    if (_ioPolicy.sequentialHint) {
+        _advise(offset, size, Sequential);
+    }
+
+    if (_map) {
+
+        // straight from the mapping, fault in the next block while we write this one
+
+        if (_ioPolicy.sequentialHint) {
+            _advise(offset, qMin(blockSize, size), WillNeed);
+        }
+
+        for (qint64 done = 0; done < size;) {
+            qint64 n = qMin(blockSize, size - done);
+
+            if (_ioPolicy.sequentialHint && done + n < size) {
+                _advise(offset + done + n, qMin(blockSize, size - done - n), WillNeed);
+            }
+
+            if (device->write(viewAt(offset + done, n)) != n) {
+                return false;
+            }
+
+            if (_ioPolicy.dropAfterCopy) {
+                _advise(offset + done, n, DontNeed);
+            }
+
+            done += n;
+
+            if (progress) {
+                progress(done);
+            }
+        }
+
+        return true;
+    }
+
+    const qint64 blocks = (size + blockSize - 1) / blockSize;
+
+    // nothing to overlap with a single block, so don't bother setting up the async machinery
+
+    if (blocks == 1) {
+        QByteArray buffer(static_cast<int>(size), '\0');
+        _allocations.fetchAndAddRelaxed(1);
+
+        if (readAt(offset, size, buffer.data()) != size || device->write(buffer) != size) {
+            return false;
+        }
+
+        if (_ioPolicy.dropAfterCopy) {
+            _advise(offset, size, DontNeed);
+        }
+
+        if (progress) {
+            progress(size);
+        }
+
+        return true;
+    }
+
+    // keep a few blocks in flight, block i always lives in slot i % depth
+
+    const int depth = 4;
+
+    // the buffers have to outlive io, which waits for anything still in flight when it goes
+
+    QVector<QByteArray> buffers(depth);
+    QVector<qint64> filled(depth, 0);
+    QVector<bool> ready(depth, false);
+    NaoAsyncIO io(this, depth);
+
+    _allocations.fetchAndAddRelaxed(depth);
+
+    auto blockLength = [&](qint64 block) {
+        return qMin(blockSize, size - block * blockSize);
+    };
+
+    for (qint64 block = 0; block < qMin<qint64>(depth, blocks); ++block) {
+        buffers[block].resize(static_cast<int>(blockLength(block)));
+        io.submitRead(offset + block * blockSize, blockLength(block), buffers[block].data(), block);
+    }
+
+    io.submit();
+
+    QVector<NaoAsyncIO::Completion> completions;
+
+    for (qint64 block = 0; block < blocks; ++block) {
+        int slot = block % depth;
+
+        while (!ready[slot]) {
+            completions.clear();
+
+            if (io.wait(completions) <= 0) {
+                return false;
+            }
+
+            for (const NaoAsyncIO::Completion& c : completions) {
+                const int done = static_cast<int>(c.tag % depth);
+                const qint64 length = blockLength(static_cast<qint64>(c.tag));
+
+                countAsyncRead(io, c.result);
+
+                // an error, or the file ended early
+
+                if (c.result <= 0) {
+                    return false;
+                }
+
+                filled[done] += c.result;
+
+                // reads may come back short, ask for the rest like _deviceReadAt does
+
+                if (filled[done] < length) {
+                    const qint64 at = static_cast<qint64>(c.tag) * blockSize + filled[done];
 
-qint16 NaoFileReader::readShortLE(uchar b[2]) {
-    return *reinterpret_cast<qint16*>(b);
+                    io.submitRead(offset + at, length - filled[done], buffers[done].data() + filled[done], c.tag);
+                    io.submit();
+                } else {
+                    ready[done] = true;
+                }
+            }
+        }
+
+        qint64 n = blockLength(block);
+
+        if (device->write(buffers[slot].constData(), n) != n) {
+            return false;
+        }
+
+        if (_ioPolicy.dropAfterCopy) {
+            _advise(offset + block * blockSize, n, DontNeed);
+        }
+
+        if (progress) {
+            progress(block * blockSize + n);
+        }
+
+        // reuse the slot for the block depth ahead
+
+        ready[slot] = false;
+        filled[slot] = 0;
+
+        if (block + depth < blocks) {
+            buffers[slot].resize(static_cast<int>(blockLength(block + depth)));
+            io.submitRead(offset + (block + depth) * blockSize, blockLength(block + depth), buffers[slot].data(), block + depth);
+            io.submit();
+        }
+    }
+
+    return true;
 }
 
-qint16 NaoFileReader::readShortBE(char b[2]) {
-    return readShortBE(reinterpret_cast<uchar*>(b));
+void NaoFileReader::_advise(qint64 offset, qint64 size, Advice advice) const {
+#ifdef Q_OS_UNIX
+    if (size <= 0) {
+        return;
+    }
+
+    if (_map) {
+
+        // madvise wants a page aligned start
+
+        qint64 start = offset & ~(pageSize() - 1);
+        qint64 length = qMin(offset + size, _windowSize) - start;
+
+        if (length > 0) {
+            int flag = (advice == Sequential) ? MADV_SEQUENTIAL : ((advice == WillNeed) ? MADV_WILLNEED : MADV_DONTNEED);
+            madvise(_map + start, static_cast<size_t>(length), flag);
+        }
+    }
+
+#ifdef Q_OS_LINUX
+
+    // dropping the pages from our mapping doesn't take them out of the page cache, so always tell the file as well
+
+    if (_fd >= 0 && (!_map || advice == DontNeed)) {
+        int flag = (advice == Sequential) ? POSIX_FADV_SEQUENTIAL : ((advice == WillNeed) ? POSIX_FADV_WILLNEED : POSIX_FADV_DONTNEED);
+        posix_fadvise(_fd, offset, size, flag);
+    }
+#endif
+#else
+    Q_UNUSED(offset);
+    Q_UNUSED(size);
+    Q_UNUSED(advice);
+#endif
 }
 
-qint16 NaoFileReader::readShortBE(uchar b[2]) {
-    qint16 v = 0;
+NaoFileReader::CopyResult NaoFileReader::_copyDirect(QIODevice* device, qint64 offset, qint64 size,
+                                                     const std::function<void(qint64)>& progress) const {
+#if defined(Q_OS_LINUX) && defined(O_DIRECT)
+
+    // needs its own descriptor, O_DIRECT can't be toggled on the shared one without affecting everyone else
+
+    QFileDevice* file = qobject_cast<QFileDevice*>(_infile);
+    QString path = file ? file->fileName() : _filename;
+
+    if (path.isEmpty()) {
+        return Unsupported;
+    }
+
+    int fd = ::open(QFile::encodeName(path).constData(), O_RDONLY | O_DIRECT | O_CLOEXEC);
+
+    if (fd < 0) {
+        return Unsupported;
+    }
+
+    // offsets, lengths and the buffer all have to be aligned to the logical block size,
+    // which is never more than the page size on anything we run on
+
+    const qint64 alignment = qMax<qint64>(pageSize(), 0x1000);
+    const qint64 blockSize = qMax(alignment, _ioPolicy.copyBlockSize / alignment * alignment);
+
+    void* buffer = nullptr;
+
+    if (posix_memalign(&buffer, static_cast<size_t>(alignment), static_cast<size_t>(blockSize)) != 0) {
+        ::close(fd);
+
+        return Unsupported;
+    }
+
+    _allocations.fetchAndAddRelaxed(1);
+
+    qint64 position = offset & ~(alignment - 1);
+    qint64 skip = offset - position;
+    qint64 done = 0;
+    CopyResult result = Copied;
+
+    while (done < size) {
+        QElapsedTimer timer;
+        timer.start();
+
+        ssize_t got;
+
+        do {
+            got = ::pread(fd, buffer, static_cast<size_t>(blockSize), position);
+        } while (got < 0 && errno == EINTR);
 
-    for (int i = 0; i < 2; i++) {
-        v <<= 8;
-        v |= b[i];
+        _deviceReads.fetchAndAddRelaxed(1);
+        _bytesRead.fetchAndAddRelaxed(qMax<qint64>(got, 0));
+        _ioNanoseconds.fetchAndAddRelaxed(timer.nsecsElapsed());
+
+        // a file system without O_DIRECT support only tells us on the first read
+
+        if (got <= skip) {
+            result = (done == 0 && got < 0 && errno == EINVAL) ? Unsupported : Failed;
+            break;
+        }
+
+        qint64 n = qMin<qint64>(got - skip, size - done);
+
+        if (device->write(static_cast<const char*>(buffer) + skip, n) != n) {
+            result = Failed;
+            break;
+        }
+
+        done += n;
+        position += blockSize;
+        skip = 0;
+
+        if (progress) {
+            progress(done);
+        }
     }
 
-    return v;
+    free(buffer);
+    ::close(fd);
+
+    return result;
+#else
+    Q_UNUSED(device);
+    Q_UNUSED(offset);
+    Q_UNUSED(size);
+    Q_UNUSED(progress);
+
+    return Unsupported;
+#endif
 }
 
-quint32 NaoFileReader::readUIntLE() {
-    return *reinterpret_cast<quint32*>(read(4).data());
+bool NaoFileReader::seekRel(qint64 p) {
+    _relativeSeeks.fetchAndAddRelaxed(1);
+
+    return _seekTo(_pos + p);
 }
 
-quint32 NaoFileReader::readUIntBE() {
-    QByteArray r = read(4);
-    quint32 v = 0;
+bool NaoFileReader::seek(qint64 p) {
+    _seeks.fetchAndAddRelaxed(1);
+
+    return _seekTo(p);
+}
 
-    for (int i = 0; i < 4; i++) {
-        v <<= 8;
-        v |= (r.at(i) & 0xFF);
+bool NaoFileReader::_seekTo(qint64 p) {
+    if (p < _pos) {
+        _backwardSeeks.fetchAndAddRelaxed(1);
     }
 
-    return v;
+    if (p < 0) {
+        return false;
+    }
+
+    // sequential devices can only go back inside the window
+
+    if (!_map && _infile->isSequential() && p < _windowStart) {
+        return false;
+    }
+
+    // the device itself is only touched once we leave the window
+
+    _pos = p;
+
+    return true;
 }
 
-quint32 NaoFileReader::readUIntLE(char b[4]) {
-    return *reinterpret_cast<quint32*>(b);
+quint8 NaoFileReader::readUChar() {
+    return read<quint8, NaoEndian::Little>();
 }
 
-quint32 NaoFileReader::readUIntLE(uchar b[4]) {
-    return *reinterpret_cast<quint32*>(b);
+qint8 NaoFileReader::readChar() {
+    return read<qint8, NaoEndian::Little>();
+}
+
+// everything below is just a named shorthand for read<T, E>() and decode<T, E>()
+
+quint16 NaoFileReader::readUShortLE() {
+    return read<quint16, NaoEndian::Little>();
 }
 
-quint32 NaoFileReader::readUIntBE(char b[4]) {
-    return readUIntBE(reinterpret_cast<uchar*>(b));
+quint16 NaoFileReader::readUShortBE() {
+    return read<quint16, NaoEndian::Big>();
 }
 
-quint32 NaoFileReader::readUIntBE(uchar b[4]) {
-    quint32 v = 0;
+quint16 NaoFileReader::readUShortLE(const char b[2]) {
+    return decode<quint16, NaoEndian::Little>(b);
+}
 
-    for (int i = 0; i < 4; i++) {
-        v <<= 8;
-        v |= b[i];
-    }
+quint16 NaoFileReader::readUShortLE(const uchar b[2]) {
+    return decode<quint16, NaoEndian::Little>(b);
+}
 
-    return v;
+quint16 NaoFileReader::readUShortBE(const char b[2]) {
+    return decode<quint16, NaoEndian::Big>(b);
 }
 
-qint32 NaoFileReader::readIntLE() {
-    return *reinterpret_cast<qint32*>(read(4).data());
+quint16 NaoFileReader::readUShortBE(const uchar b[2]) {
+    return decode<quint16, NaoEndian::Big>(b);
 }
 
-qint32 NaoFileReader::readIntBE() {
-    QByteArray r = read(4);
-    qint32 v = 0;
+qint16 NaoFileReader::readShortLE() {
+    return read<qint16, NaoEndian::Little>();
+}
 
-    for (int i = 0; i < 4; i++) {
-        v <<= 8;
-        v |= (r.at(i) & 0xFF);
-    }
+qint16 NaoFileReader::readShortBE() {
+    return read<qint16, NaoEndian::Big>();
+}
 
-    return v;
+qint16 NaoFileReader::readShortLE(const char b[2]) {
+    return decode<qint16, NaoEndian::Little>(b);
 }
 
-qint32 NaoFileReader::readIntLE(char b[4]) {
-    return *reinterpret_cast<qint32*>(b);
+qint16 NaoFileReader::readShortLE(const uchar b[2]) {
+    return decode<qint16, NaoEndian::Little>(b);
 }
 
-qint32 NaoFileReader::readIntLE(uchar b[4]) {
-    return *reinterpret_cast<qint32*>(b);
+qint16 NaoFileReader::readShortBE(const char b[2]) {
+    return decode<qint16, NaoEndian::Big>(b);
 }
 
-qint32 NaoFileReader::readIntBE(char b[4]) {
-    return readIntBE(reinterpret_cast<uchar*>(b));
+qint16 NaoFileReader::readShortBE(const uchar b[2]) {
+    return decode<qint16, NaoEndian::Big>(b);
 }
 
-qint32 NaoFileReader::readIntBE(uchar b[4]) {
-    qint32 v = 0;
+quint32 NaoFileReader::readUIntLE() {
+    return read<quint32, NaoEndian::Little>();
+}
 
-    for (int i = 0; i < 4; i++) {
-        v <<= 8;
-        v |= b[i];
-    }
+quint32 NaoFileReader::readUIntBE() {
+    return read<quint32, NaoEndian::Big>();
+}
 
-    return v;
+quint32 NaoFileReader::readUIntLE(const char b[4]) {
+    return decode<quint32, NaoEndian::Little>(b);
 }
 
-quint64 NaoFileReader::readULongLE() {
-    return *reinterpret_cast<quint64*>(read(8).data());
+quint32 NaoFileReader::readUIntLE(const uchar b[4]) {
+    return decode<quint32, NaoEndian::Little>(b);
 }
 
-quint64 NaoFileReader::readULongBE() {
-    QByteArray r = read(8);
-    quint64 v = 0;
+quint32 NaoFileReader::readUIntBE(const char b[4]) {
+    return decode<quint32, NaoEndian::Big>(b);
+}
 
-    for (int i = 0; i < 8; i++) {
-        v <<= 8;
-        v |= (r.at(i) & 0xFF);
-    }
+quint32 NaoFileReader::readUIntBE(const uchar b[4]) {
+    return decode<quint32, NaoEndian::Big>(b);
+}
 
-    return v;
+qint32 NaoFileReader::readIntLE() {
+    return read<qint32, NaoEndian::Little>();
 }
 
-quint64 NaoFileReader::readULongLE(char b[8]) {
-    return *reinterpret_cast<quint64*>(b);
+qint32 NaoFileReader::readIntBE() {
+    return read<qint32, NaoEndian::Big>();
 }
 
-quint64 NaoFileReader::readULongLE(uchar b[8]) {
-    return *reinterpret_cast<quint64*>(b);
+qint32 NaoFileReader::readIntLE(const char b[4]) {
+    return decode<qint32, NaoEndian::Little>(b);
 }
 
-quint64 NaoFileReader::readULongBE(char b[8]) {
-    return readULongBE(reinterpret_cast<uchar*>(b));
+qint32 NaoFileReader::readIntLE(const uchar b[4]) {
+    return decode<qint32, NaoEndian::Little>(b);
 }
 
-quint64 NaoFileReader::readULongBE(uchar b[8]) {
-    quint64 v = 0;
+qint32 NaoFileReader::readIntBE(const char b[4]) {
+    return decode<qint32, NaoEndian::Big>(b);
+}
 
-    for (int i = 0; i < 8; i++) {
-        v <<= 8;
-        v |= b[i];
-    }
+qint32 NaoFileReader::readIntBE(const uchar b[4]) {
+    return decode<qint32, NaoEndian::Big>(b);
+}
 
-    return v;
+quint64 NaoFileReader::readULongLE() {
+    return read<quint64, NaoEndian::Little>();
 }
 
-qint64 NaoFileReader::readLongLE() {
-    return *reinterpret_cast<qint64*>(read(8).data());
+quint64 NaoFileReader::readULongBE() {
+    return read<quint64, NaoEndian::Big>();
 }
 
-qint64 NaoFileReader::readLongBE() {
-    QByteArray r = read(8);
-    qint64 v = 0;
+quint64 NaoFileReader::readULongLE(const char b[8]) {
+    return decode<quint64, NaoEndian::Little>(b);
+}
 
-    for (int i = 0; i < 8; i++) {
-        v <<= 8;
-        v |= (r.at(i) & 0xFF);
-    }
+quint64 NaoFileReader::readULongLE(const uchar b[8]) {
+    return decode<quint64, NaoEndian::Little>(b);
+}
 
-    return v;
+quint64 NaoFileReader::readULongBE(const char b[8]) {
+    return decode<quint64, NaoEndian::Big>(b);
 }
 
-qint64 NaoFileReader::readLongLE(char b[8]) {
-    return *reinterpret_cast<qint64*>(b);
+quint64 NaoFileReader::readULongBE(const uchar b[8]) {
+    return decode<quint64, NaoEndian::Big>(b);
 }
 
-qint64 NaoFileReader::readLongLE(uchar b[8]) {
-    return *reinterpret_cast<qint64*>(b);
+qint64 NaoFileReader::readLongLE() {
+    return read<qint64, NaoEndian::Little>();
 }
 
-qint64 NaoFileReader::readLongBE(char b[8]) {
-    return readLongBE(reinterpret_cast<uchar*>(b));
+qint64 NaoFileReader::readLongBE() {
+    return read<qint64, NaoEndian::Big>();
 }
 
-qint64 NaoFileReader::readLongBE(uchar b[8]) {
-    qint64 v = 0;
+qint64 NaoFileReader::readLongLE(const char b[8]) {
+    return decode<qint64, NaoEndian::Little>(b);
+}
 
-    for (int i = 0; i < 8; i++) {
-        v <<= 8;
-        v |= b[i];
-    }
+qint64 NaoFileReader::readLongLE(const uchar b[8]) {
+    return decode<qint64, NaoEndian::Little>(b);
+}
+
+qint64 NaoFileReader::readLongBE(const char b[8]) {
+    return decode<qint64, NaoEndian::Big>(b);
+}
 
-    return v;
+qint64 NaoFileReader::readLongBE(const uchar b[8]) {
+    return decode<qint64, NaoEndian::Big>(b);
 }
 
 float NaoFileReader::readFloatLE() {
-    return *reinterpret_cast<float*>(read(4).data());
+    return read<float, NaoEndian::Little>();
 }
 
 float NaoFileReader::readFloatBE() {
-    QByteArray r = read(4);
-    quint32 v = 0;
+    return read<float, NaoEndian::Big>();
+}
 
-    for (int i = 0; i < 4; i++) {
-        v <<= 8;
-        v |= (r.at(i) & 0xFF);
-    }
+float NaoFileReader::readFloatLE(const char b[4]) {
+    return decode<float, NaoEndian::Little>(b);
+}
+
+float NaoFileReader::readFloatLE(const uchar b[4]) {
+    return decode<float, NaoEndian::Little>(b);
+}
+
+float NaoFileReader::readFloatBE(const char b[4]) {
+    return decode<float, NaoEndian::Big>(b);
+}
 
-    return *reinterpret_cast<float*>(&v);
+float NaoFileReader::readFloatBE(const uchar b[4]) {
+    return decode<float, NaoEndian::Big>(b);
 }
 
-float NaoFileReader::readFloatLE(char b[4]) {
-    return *reinterpret_cast<float*>(b);
+double NaoFileReader::readDoubleLE() {
+    return read<double, NaoEndian::Little>();
 }
 
-float NaoFileReader::readFloatLE(uchar b[4]) {
-    return *reinterpret_cast<float*>(b);
+double NaoFileReader::readDoubleBE() {
+    return read<double, NaoEndian::Big>();
 }
 
-float NaoFileReader::readFloatBE(char b[4]) {
-    return readFloatBE(reinterpret_cast<uchar*>(b));
+double NaoFileReader::readDoubleLE(const char b[8]) {
+    return decode<double, NaoEndian::Little>(b);
 }
 
-float NaoFileReader::readFloatBE(uchar b[4]) {
-    quint32 v = 0;
+double NaoFileReader::readDoubleLE(const uchar b[8]) {
+    return decode<double, NaoEndian::Little>(b);
+}
 
-    for (int i = 0; i < 4; i++) {
-        v <<= 8;
-        v |= b[i];
-    }
+double NaoFileReader::readDoubleBE(const char b[8]) {
+    return decode<double, NaoEndian::Big>(b);
+}
 
-    return *reinterpret_cast<float*>(&v);
+double NaoFileReader::readDoubleBE(const uchar b[8]) {
+    return decode<double, NaoEndian::Big>(b);
 }
 
-double NaoFileReader::readDoubleLE() {
-    return *reinterpret_cast<double*>(read(8).data());
+QString NaoFileReader::readString() {
+    return QString::fromLatin1(readStringView());
 }
 
-double NaoFileReader::readDoubleBE() {
-    QByteArray r = read(8);
-    quint64 v = 0;
+QByteArray NaoFileReader::readStringView() {
+    QByteArray owned;
+
+    // look for the null in whatever the window holds, only copying if the string crosses a refill
 
-    for (int i = 0; i < 8; i++) {
-        v <<= 8;
-        v |= (r.at(i) & 0xFF);
+    for (;;) {
+        if (_pos < _windowStart || _pos >= _windowStart + _windowSize) {
+            if (_map || !_fill()) {
+                break;
+            }
+        }
+
+        const char* start = reinterpret_cast<const char*>(_window + (_pos - _windowStart));
+        qint64 available = _windowStart + _windowSize - _pos;
+        const char* end = static_cast<const char*>(memchr(start, '\0', available));
+
+        if (end) {
+            qint64 length = end - start;
+            _pos += length + 1;
+
+            if (_map) {
+                _bytesRead.fetchAndAddRelaxed(length + 1);
+            }
+
+            if (owned.isEmpty()) {
+                return QByteArray::fromRawData(start, length);
+            }
+
+            return owned.append(start, length);
+        }
+
+        if (owned.isEmpty()) {
+            _allocations.fetchAndAddRelaxed(1);
+        }
+
+        owned.append(start, available);
+        _pos += available;
+
+        if (_map) {
+            _bytesRead.fetchAndAddRelaxed(available);
+        }
     }
 
-    return *reinterpret_cast<double*>(&v);
+    return owned;
 }
 
-double NaoFileReader::readDoubleLE(char b[8]) {
-    return *reinterpret_cast<double*>(b);
+QHash<qint64, QByteArray> NaoFileReader::readStringTable(qint64 size) {
+    QHash<qint64, QByteArray> table;
+
+    _allocations.fetchAndAddRelaxed(1);
+
+    QByteArray raw = readView(size);
+    const char* data = raw.constData();
+    qint64 offset = 0;
+
+    // one pass over the table, splitting on every null
+
+    while (offset < raw.size()) {
+        const char* end = static_cast<const char*>(memchr(data + offset, '\0', raw.size() - offset));
+        qint64 length = end ? (end - (data + offset)) : (raw.size() - offset);
+
+        table.insert(offset, _map ? QByteArray::fromRawData(data + offset, length) : QByteArray(data + offset, length));
+
+        offset += length + 1;
+    }
+
+    return table;
 }
 
-double NaoFileReader::readDoubleLE(uchar b[8]) {
-    return *reinterpret_cast<float*>(b);
+NaoFileReader::IOStats NaoFileReader::IOStats::operator-(const IOStats& other) const {
+    IOStats r;
+    r.bytesRead = bytesRead - other.bytesRead;
+    r.deviceReads = deviceReads - other.deviceReads;
+    r.seeks = seeks - other.seeks;
+    r.relativeSeeks = relativeSeeks - other.relativeSeeks;
+    r.backwardSeeks = backwardSeeks - other.backwardSeeks;
+    r.allocations = allocations - other.allocations;
+    r.ioNanoseconds = ioNanoseconds - other.ioNanoseconds;
+
+    return r;
 }
 
-double NaoFileReader::readDoubleBE(char b[8]) {
-    return readDoubleBE(reinterpret_cast<uchar*>(b));
+NaoFileReader::IOStats NaoFileReader::ioStats() const {
+    IOStats r;
+    r.bytesRead = _bytesRead.load();
+    r.deviceReads = _deviceReads.load();
+    r.seeks = _seeks.load();
+    r.relativeSeeks = _relativeSeeks.load();
+    r.backwardSeeks = _backwardSeeks.load();
+    r.allocations = _allocations.load();
+    r.ioNanoseconds = _ioNanoseconds.load();
+
+    return r;
 }
 
-double NaoFileReader::readDoubleBE(uchar b[8]) {
-    quint64 v = 0;
+void NaoFileReader::resetIOStats() {
+    _bytesRead.store(0);
+    _deviceReads.store(0);
+    _seeks.store(0);
+    _relativeSeeks.store(0);
+    _backwardSeeks.store(0);
+    _allocations.store(0);
+    _ioNanoseconds.store(0);
 
-    for (int i = 0; i < 8; i++) {
-        v <<= 8;
-        v |= b[i];
-    }
+    // an open phase would subtract from the old counters otherwise
 
-    return *reinterpret_cast<double*>(&v);
+    _phaseStart = IOStats();
 }
 
-QString NaoFileReader::readString() {
-    QByteArray r;
+const QMap<QString, NaoFileReader::IOStats>& NaoFileReader::phaseStats() const {
+    return _phaseStats;
+}
 
-    // read untill we find a null
+void NaoFileReader::countAllocation() const {
+    _allocations.fetchAndAddRelaxed(1);
+}
 
-    do {
-        r.append(*read(1));
-    } while (r.at(r.size() - 1) != '\0');
+void NaoFileReader::countAsyncRead(const NaoAsyncIO& io, qint64 result) const {
+    if (io.backend() == NaoAsyncIO::IOUring) {
+        _deviceReads.fetchAndAddRelaxed(1);
+        _bytesRead.fetchAndAddRelaxed(qMax<qint64>(result, 0));
+    }
+}
 
-    return QString::fromLatin1(r);
+void NaoFileReader::beginPhase(const QString& name) {
+    _phase = name;
+    _phaseStart = ioStats();
+}
+
+void NaoFileReader::endPhase() {
+    if (!_phase.isNull()) {
+        _phaseStats.insert(_phase, ioStats() - _phaseStart);
+        _phase = QString();
+    }
 }
 
 NaoFileReader::~NaoFileReader() {
+    if (_map) {
+        static_cast<QFile*>(_infile)->unmap(_map);
+    }
+
     _infile->close();
 }
 
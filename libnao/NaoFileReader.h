@@ -2,86 +2,244 @@
 #define NAOFILEREADER_H
 
 #include "libnao_global.h"
+#include "NaoEndian.h"
 
 #include <QFile>
+#include <QHash>
+#include <QMutex>
+#include <QMap>
+#include <QAtomicInteger>
+
+#include <functional>
+
+class NaoAsyncIO;
 
 class LIBNAO_API NaoFileReader : public QObject {
     Q_OBJECT
 
     public:
-    NaoFileReader(QString infile);
+    static constexpr qint64 DefaultBufferSize = 0x10000;
+
+    // cheap I/O counters, bytes and reads refer to the mapping if we're mapped and to the device otherwise
+    struct IOStats {
+        quint64 bytesRead = 0;
+        quint64 deviceReads = 0;        // read calls that reached the device (pread, QIODevice::read, io_uring)
+        quint64 seeks = 0;              // seek()
+        quint64 relativeSeeks = 0;      // seekRel()
+        quint64 backwardSeeks = 0;      // either of the above going backwards
+        quint64 allocations = 0;        // temporary buffers allocated by reads
+        quint64 ioNanoseconds = 0;      // time spent blocking on the device
+
+        IOStats operator-(const IOStats& other) const;
+    };
+
+    // how bulk copies (extraction) read the file and treat the page cache
+    struct IOPolicy {
+        qint64 copyBlockSize = 0x400000;    // per read/write during a copy
+        bool sequentialHint = true;         // tell the kernel copies read front to back and to start reading ahead
+        bool dropAfterCopy = false;         // evict copied ranges from the page cache, keeps big extractions from thrashing it
+        qint64 directThreshold = 0;         // bypass the page cache (O_DIRECT) for copies at least this big, 0 never does
+    };
+
+    NaoFileReader(QString infile);  // memory-maps the file if possible
     NaoFileReader(QIODevice* device, QString filename = QString());
 
     ~NaoFileReader();
 
     QString getFileName() const;
-    QIODevice* getDevice() const;
+    QIODevice* getDevice() const;   // the device position is not kept in sync with pos()
     QString fourCC() const;     // first 4 bytes as a string
     qint64 pos() const;
+    qint64 size() const;
+    bool atEnd() const;
+    bool isMapped() const;
+    int nativeHandle() const;       // file descriptor usable for positional reads, -1 if there is none
+
+    // counters since construction or the last reset, safe to read while other threads are extracting
+    IOStats ioStats() const;
+    void resetIOStats();
+
+    // what each phase of opening the file cost (header, TOC, ETOC, USM chunks, ...)
+    const QMap<QString, IOStats>& phaseStats() const;
+
+    // size of the read-ahead buffer used when we're not mapped
+    qint64 bufferSize() const;
+    void setBufferSize(qint64 size);
+
+    IOPolicy ioPolicy() const;
+    void setIOPolicy(const IOPolicy& policy);
+
+    static qint64 pageSize();
 
     QByteArray read(qint64 n);
+    QByteArray readView(qint64 n);  // non-owning slice of the mapping when mapped, only valid while the reader lives
+
+    // positional reads: these leave pos() alone and are safe to call from multiple threads at once
+    qint64 readAt(qint64 offset, qint64 n, char* dst) const;
+    QByteArray readAt(qint64 offset, qint64 n) const;
+    QByteArray viewAt(qint64 offset, qint64 n) const;   // non-owning if mapped, like readView
+
+    // read a single T stored with endianness E
+    template <typename T, NaoEndian E>
+    T read() {
+        uchar b[sizeof(T)];
+        _readInto(b, sizeof(T));
+
+        return NaoBytes::load<T, E>(b);
+    }
+
+    // decode a T stored with endianness E from memory
+    template <typename T, NaoEndian E>
+    static T decode(const void* b) {
+        return NaoBytes::load<T, E>(b);
+    }
+
+    // read n values in one go and convert them to host order, returns the number of complete values read
+    template <typename T, NaoEndian E>
+    qint64 readArray(qint64 n, T* out) {
+        qint64 got = _readInto(out, n * sizeof(T)) / sizeof(T);
+        NaoBytes::toHost<T, E>(out, n);
+
+        return got;
+    }
+
     bool seekRel(qint64 p);         // seek relative to the current position
     bool seek(qint64 p);
     quint8 readUChar();
     qint8 readChar();
     quint16 readUShortLE();
     quint16 readUShortBE();
-    static quint16 readUShortLE(char b[2]);
-    static quint16 readUShortLE(uchar b[2]);
-    static quint16 readUShortBE(char b[2]);
-    static quint16 readUShortBE(uchar b[2]);
+    static quint16 readUShortLE(const char b[2]);
+    static quint16 readUShortLE(const uchar b[2]);
+    static quint16 readUShortBE(const char b[2]);
+    static quint16 readUShortBE(const uchar b[2]);
     qint16 readShortLE();
     qint16 readShortBE();
-    static qint16 readShortLE(char b[2]);
-    static qint16 readShortLE(uchar b[2]);
-    static qint16 readShortBE(char b[2]);
-    static qint16 readShortBE(uchar b[2]);
+    static qint16 readShortLE(const char b[2]);
+    static qint16 readShortLE(const uchar b[2]);
+    static qint16 readShortBE(const char b[2]);
+    static qint16 readShortBE(const uchar b[2]);
     quint32 readUIntLE();
     quint32 readUIntBE();
-    static quint32 readUIntLE(char b[4]);
-    static quint32 readUIntLE(uchar b[4]);
-    static quint32 readUIntBE(char b[4]);
-    static quint32 readUIntBE(uchar b[4]);
+    static quint32 readUIntLE(const char b[4]);
+    static quint32 readUIntLE(const uchar b[4]);
+    static quint32 readUIntBE(const char b[4]);
+    static quint32 readUIntBE(const uchar b[4]);
     qint32 readIntLE();
     qint32 readIntBE();
-    static qint32 readIntLE(char b[4]);
-    static qint32 readIntLE(uchar b[4]);
-    static qint32 readIntBE(char b[4]);
-    static qint32 readIntBE(uchar b[4]);
+    static qint32 readIntLE(const char b[4]);
+    static qint32 readIntLE(const uchar b[4]);
+    static qint32 readIntBE(const char b[4]);
+    static qint32 readIntBE(const uchar b[4]);
     quint64 readULongLE();
     quint64 readULongBE();
-    static quint64 readULongLE(char b[8]);
-    static quint64 readULongLE(uchar b[8]);
-    static quint64 readULongBE(char b[8]);
-    static quint64 readULongBE(uchar b[8]);
+    static quint64 readULongLE(const char b[8]);
+    static quint64 readULongLE(const uchar b[8]);
+    static quint64 readULongBE(const char b[8]);
+    static quint64 readULongBE(const uchar b[8]);
     qint64 readLongLE();
     qint64 readLongBE();
-    static qint64 readLongLE(char b[8]);
-    static qint64 readLongLE(uchar b[8]);
-    static qint64 readLongBE(char b[8]);
-    static qint64 readLongBE(uchar b[8]);
+    static qint64 readLongLE(const char b[8]);
+    static qint64 readLongLE(const uchar b[8]);
+    static qint64 readLongBE(const char b[8]);
+    static qint64 readLongBE(const uchar b[8]);
     float readFloatLE();
     float readFloatBE();
-    static float readFloatLE(char b[4]);
-    static float readFloatLE(uchar b[4]);
-    static float readFloatBE(char b[4]);
-    static float readFloatBE(uchar b[4]);
+    static float readFloatLE(const char b[4]);
+    static float readFloatLE(const uchar b[4]);
+    static float readFloatBE(const char b[4]);
+    static float readFloatBE(const uchar b[4]);
     double readDoubleLE();
     double readDoubleBE();
-    static double readDoubleLE(char b[8]);
-    static double readDoubleLE(uchar b[8]);
-    static double readDoubleBE(char b[8]);
-    static double readDoubleBE(uchar b[8]);
+    static double readDoubleLE(const char b[8]);
+    static double readDoubleLE(const uchar b[8]);
+    static double readDoubleBE(const char b[8]);
+    static double readDoubleBE(const uchar b[8]);
     QString readString();
 
+    // the string without its null, non-owning where possible: valid while the reader lives if mapped,
+    // otherwise only until the next read
+    QByteArray readStringView();
+
+    // split the next size bytes into null-terminated strings, keyed by their offset in the table (views if mapped)
+    QHash<qint64, QByteArray> readStringTable(qint64 size);
+
     protected:
+    // copy size bytes at offset to device in blocks of ioPolicy().copyBlockSize, calling progress with the number
+    // of bytes done after each one. only positional reads, and when not mapped the next blocks are read
+    // asynchronously while writing (or with O_DIRECT, if the policy says so)
+    bool copyTo(QIODevice* device, qint64 offset, qint64 size,
+                const std::function<void(qint64)>& progress = nullptr) const;
+
+    // for NaoAsyncIO reads made outside of copyTo: a buffer allocated for one, and one that finished with result.
+    // the thread pool backend goes through readAt, which already counts itself
+    void countAllocation() const;
+    void countAsyncRead(const NaoAsyncIO& io, qint64 result) const;
+
+    // record the counters between these two under name in phaseStats()
+    void beginPhase(const QString& name);
+    void endPhase();
+
     QString _filename;
     QString _fourCC;
 
     private:
     QIODevice* _infile;
 
+    // the window is either the whole-file mapping or the read-ahead buffer,
+    // reads are just pointer bumps through this
+
+    uchar* _map = nullptr;
+    QByteArray _buffer;
+    qint64 _bufferSize = DefaultBufferSize;
+    IOPolicy _ioPolicy;
+
+    const uchar* _window = nullptr;
+    qint64 _windowStart = 0;
+    qint64 _windowSize = 0;
+    qint64 _pos = 0;
+
+    // native handle for pread, -1 if we have to go through the device (under the lock)
+
+    int _fd = -1;
+    mutable QMutex _deviceLock;
+
+    // counters behind ioStats(), atomic since positional reads come from any thread
+
+    mutable QAtomicInteger<quint64> _bytesRead;
+    mutable QAtomicInteger<quint64> _deviceReads;
+    QAtomicInteger<quint64> _seeks;
+    QAtomicInteger<quint64> _relativeSeeks;
+    QAtomicInteger<quint64> _backwardSeeks;
+    mutable QAtomicInteger<quint64> _allocations;
+    mutable QAtomicInteger<quint64> _ioNanoseconds;
+
+    QString _phase;
+    IOStats _phaseStart;
+    QMap<QString, IOStats> _phaseStats;
+
     void _NaoFileReaderStartup();
+    qint64 _readInto(void* dst, qint64 n);
+    bool _fill();
+    qint64 _deviceReadAt(qint64 offset, char* dst, qint64 n) const;
+    qint64 _deviceRead(char* dst, qint64 n);
+    bool _seekTo(qint64 p);
+
+    enum Advice {
+        Sequential = 0,
+        WillNeed,
+        DontNeed
+    };
+
+    enum CopyResult {
+        Copied = 0,
+        Failed,
+        Unsupported
+    };
+
+    void _advise(qint64 offset, qint64 size, Advice advice) const;
+    CopyResult _copyDirect(QIODevice* device, qint64 offset, qint64 size,
+                           const std::function<void(qint64)>& progress) const;
 };
 
 #endif // NAOFILEREADER_H
@@ -0,0 +1,493 @@
+#include "NaoIndexCache.h"
+#include "NaoCRIWareReader.h"
+#include "NaoDATReader.h"
+#include "NaoEndian.h"
+
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QDateTime>
+#include <QDir>
+
+#include <cstring>
+
+namespace {
+    enum Kind : quint32 {
+        CPK = 1,
+        USM = 2,
+        DAT = 3
+    };
+
+    // sizes of the header and of each kind of record
+
+    constexpr qint64 headerSize = 0x80;
+    constexpr qint64 entrySize = 0xA0;
+    constexpr qint64 chunkSize = 0x18;
+    constexpr qint64 datEntrySize = 0x10;
+
+    // how much of the archive goes into the header hash, enough for the headers of all three formats
+    constexpr qint64 hashedBytes = 0x800;
+
+    const char magic[8] = { 'N', 'A', 'O', 'I', 'N', 'D', 'E', 'X' };
+
+    // FNV-1a, 64 bit
+    quint64 hash(const char* data, qint64 size) {
+        quint64 h = 0xCBF29CE484222325ULL;
+
+        for (qint64 i = 0; i < size; i++) {
+            h = (h ^ static_cast<uchar>(data[i])) * 0x100000001B3ULL;
+        }
+
+        return h;
+    }
+
+    // what an index has to match to be used
+    struct Identity {
+        QString path;
+        qint64 size;
+        qint64 mtime;
+        quint64 headerHash;
+    };
+
+    bool identify(const NaoFileReader& reader, Identity& identity) {
+        QString path = reader.getFileName();
+
+        if (path.isEmpty()) {
+            QFileDevice* file = qobject_cast<QFileDevice*>(reader.getDevice());
+
+            if (file) {
+                path = file->fileName();
+            }
+        }
+
+        if (path.isEmpty()) {
+            return false;
+        }
+
+        QFileInfo info(path);
+
+        if (!info.exists() || info.size() != reader.size()) {
+            return false;
+        }
+
+        const QByteArray head = reader.readAt(0, qMin(hashedBytes, reader.size()));
+
+        identity.path = info.absoluteFilePath();
+        identity.size = info.size();
+        identity.mtime = info.lastModified().toMSecsSinceEpoch();
+        identity.headerHash = hash(head.constData(), head.size());
+
+        return true;
+    }
+
+    // builds an index: records are appended as they come, strings go in the pool as they're first seen
+    class IndexWriter {
+        public:
+        IndexWriter(Kind kind, const Identity& identity) : _out(static_cast<int>(headerSize), '\0') {
+            memcpy(_out.data(), magic, sizeof(magic));
+
+            patch<quint32>(0x08, NaoIndexCache::version);
+            patch<quint32>(0x0C, kind);
+            patch<qint64>(0x10, identity.size);
+            patch<qint64>(0x18, identity.mtime);
+            patch<quint64>(0x20, identity.headerHash);
+
+            patch<quint32>(0x28, string(identity.path));
+            patch<quint32>(0x2C, static_cast<quint32>(identity.path.size()));
+        }
+
+        template <typename T>
+        void put(T v) {
+            char bytes[sizeof(T)];
+            NaoBytes::store<T, NaoEndian::Little>(v, bytes);
+
+            _out.append(bytes, sizeof(T));
+        }
+
+        template <typename T>
+        void patch(qint64 offset, T v) {
+            NaoBytes::store<T, NaoEndian::Little>(v, _out.data() + offset);
+        }
+
+        void putString(const QString& str) {
+            put<quint32>(string(str));
+            put<quint32>(static_cast<quint32>(str.size()));
+        }
+
+        qint64 pos() const {
+            return _out.size();
+        }
+
+        // the pool goes last, 8 byte aligned
+        QByteArray finish() {
+            while (_out.size() % 8) {
+                _out.append('\0');
+            }
+
+            patch<quint64>(0x48, static_cast<quint64>(_out.size()));
+            patch<quint64>(0x50, static_cast<quint64>(_pool.size()));
+
+            for (ushort unit : _pool) {
+                put<quint16>(unit);
+            }
+
+            return _out;
+        }
+
+        private:
+
+        // pool offset of str in UTF-16 units, identical strings (every entry of a directory) are stored once
+        quint32 string(const QString& str) {
+            QHash<QString, quint32>::const_iterator it = _offsets.constFind(str);
+
+            if (it != _offsets.constEnd()) {
+                return it.value();
+            }
+
+            const quint32 offset = static_cast<quint32>(_pool.size());
+
+            for (QChar c : str) {
+                _pool.append(c.unicode());
+            }
+
+            _offsets.insert(str, offset);
+
+            return offset;
+        }
+
+        QByteArray _out;
+        QVector<ushort> _pool;
+        QHash<QString, quint32> _offsets;
+    };
+
+    // an index file, mapped if possible. open() checks everything the records rely on, so reading them afterwards
+    // only has to check the string references
+    class IndexReader {
+        public:
+        ~IndexReader() {
+            if (_map) {
+                _file.unmap(_map);
+            }
+        }
+
+        bool open(const QString& path, Kind kind, const Identity& identity) {
+            _file.setFileName(path);
+
+            if (!_file.open(QIODevice::ReadOnly) || _file.size() < headerSize) {
+                return false;
+            }
+
+            _map = _file.map(0, _file.size());
+
+            if (_map) {
+                _data = _map;
+                _size = _file.size();
+            } else {
+                _copy = _file.readAll();
+                _data = reinterpret_cast<const uchar*>(_copy.constData());
+                _size = _copy.size();
+            }
+
+            if (_size < headerSize || memcmp(_data, magic, sizeof(magic)) != 0
+                    || get<quint32>(0x08) != NaoIndexCache::version || get<quint32>(0x0C) != kind
+                    || get<qint64>(0x10) != identity.size || get<qint64>(0x18) != identity.mtime
+                    || get<quint64>(0x20) != identity.headerHash) {
+                return false;
+            }
+
+            entries = get<quint32>(0x30);
+            chunks = get<quint32>(0x34);
+            entriesOffset = get<quint64>(0x38);
+            chunksOffset = get<quint64>(0x40);
+            _poolOffset = get<quint64>(0x48);
+            _poolUnits = get<quint64>(0x50);
+
+            const qint64 recordSize = (kind == DAT) ? datEntrySize : entrySize;
+
+            if (!fits(entriesOffset, recordSize * entries) || !fits(chunksOffset, chunkSize * chunks)
+                    || !fits(_poolOffset, 2 * _poolUnits) || (_poolOffset % 2) != 0) {
+                return false;
+            }
+
+            // the hash could collide, the path can't
+
+            QString archivePath;
+
+            return string(0x28, archivePath) && archivePath == identity.path;
+        }
+
+        template <typename T>
+        T get(quint64 offset) const {
+            return NaoBytes::load<T, NaoEndian::Little>(_data + offset);
+        }
+
+        // the string referenced at offset, false if the reference is out of the pool
+        bool string(quint64 offset, QString& str) {
+            const quint32 start = get<quint32>(offset);
+            const quint32 length = get<quint32>(offset + 4);
+
+            if (static_cast<quint64>(start) + length > _poolUnits) {
+                return false;
+            }
+
+            // identical strings are stored once, so they can share one QString as well
+
+            QHash<quint32, QString>::const_iterator it = _strings.constFind(start);
+
+            if (it != _strings.constEnd() && it.value().size() == static_cast<int>(length)) {
+                str = it.value();
+                return true;
+            }
+
+            str = QString(reinterpret_cast<const QChar*>(_data + _poolOffset + 2ULL * start), static_cast<int>(length));
+            NaoBytes::toHost<ushort, NaoEndian::Little>(reinterpret_cast<ushort*>(str.data()), length);
+
+            _strings.insert(start, str);
+
+            return true;
+        }
+
+        quint32 entries = 0;
+        quint32 chunks = 0;
+        quint64 entriesOffset = 0;
+        quint64 chunksOffset = 0;
+
+        private:
+        bool fits(quint64 offset, quint64 size) const {
+            return offset >= static_cast<quint64>(headerSize) && offset <= static_cast<quint64>(_size)
+                    && size <= static_cast<quint64>(_size) - offset;
+        }
+
+        QFile _file;
+        uchar* _map = nullptr;
+        QByteArray _copy;
+
+        const uchar* _data = nullptr;
+        qint64 _size = 0;
+
+        quint64 _poolOffset = 0;
+        quint64 _poolUnits = 0;
+
+        QHash<quint32, QString> _strings;
+    };
+}
+
+NaoIndexCache::NaoIndexCache(const QString& directory) : _directory(directory) {
+
+}
+
+QString NaoIndexCache::directory() const {
+    return _directory;
+}
+
+QString NaoIndexCache::indexPath(const QString& path) const {
+    const QString absolute = QFileInfo(path).absoluteFilePath();
+    const quint64 h = hash(reinterpret_cast<const char*>(absolute.utf16()), absolute.size() * 2LL);
+
+    return QDir(_directory).filePath(QString::number(h, 16).rightJustified(16, '0') + ".naoidx");
+}
+
+bool NaoIndexCache::load(NaoCRIWareReader& reader) const {
+    Identity identity;
+    IndexReader index;
+
+    // where the reader was, so it can go on parsing from there if the index is no good
+    const qint64 start = reader.pos();
+
+    if (!identify(reader, identity) || !index.open(indexPath(identity.path), reader._isPak ? CPK : USM, identity)) {
+        return false;
+    }
+
+    QVector<NaoCRIWareReader::EmbeddedFile> files(static_cast<int>(index.entries));
+
+    for (quint32 i = 0; i < index.entries; i++) {
+        NaoCRIWareReader::EmbeddedFile& file = files[static_cast<int>(i)];
+        const quint64 record = index.entriesOffset + i * entrySize;
+
+        if (!index.string(record, file.origin) || !index.string(record + 0x08, file.name)
+                || !index.string(record + 0x10, file.path) || !index.string(record + 0x18, file.userString)
+                || !index.string(record + 0x20, file.localDir)) {
+            return false;
+        }
+
+        file.offset = index.get<qint64>(record + 0x28);
+        file.extraOffset = index.get<qint64>(record + 0x30);
+        file.size = index.get<qint64>(record + 0x38);
+        file.extractedSize = index.get<qint64>(record + 0x40);
+        file.id = index.get<quint32>(record + 0x48);
+        file.type = static_cast<NaoCRIWareReader::EmbeddedFile::Type>(index.get<quint32>(record + 0x4C));
+        file.avbps = index.get<qint64>(record + 0x50);
+        file.width = index.get<qint64>(record + 0x58);
+        file.height = index.get<qint64>(record + 0x60);
+        file.totalFrames = index.get<qint64>(record + 0x68);
+        file.nFramerate = index.get<qint64>(record + 0x70);
+        file.dFramerate = index.get<qint64>(record + 0x78);
+        file.sampleRate = index.get<qint64>(record + 0x80);
+        file.sampleCount = index.get<qint64>(record + 0x88);
+        file.channelCount = index.get<qint64>(record + 0x90);
+        file.updateDateTime = index.get<quint64>(record + 0x98);
+    }
+
+    QVector<NaoCRIWareReader::Chunk> chunks(static_cast<int>(index.chunks));
+
+    for (quint32 i = 0; i < index.chunks; i++) {
+        NaoCRIWareReader::Chunk& chunk = chunks[static_cast<int>(i)];
+        const quint64 record = index.chunksOffset + i * chunkSize;
+
+        chunk.type = static_cast<NaoCRIWareReader::Chunk::Type>(index.get<quint32>(record));
+        chunk.dataType = static_cast<NaoCRIWareReader::Chunk::DataType>(index.get<quint32>(record + 0x04));
+        chunk.size = index.get<quint32>(record + 0x08);
+        chunk.headerSize = index.get<quint16>(record + 0x0C);
+        chunk.footerSize = index.get<quint16>(record + 0x0E);
+        chunk.offset = index.get<qint64>(record + 0x10);
+    }
+
+    // the GTOC is kept as a table, it's a single read. the startup parses where it left off if this doesn't work out
+
+    const qint64 gtocOffset = index.get<qint64>(0x60);
+    QByteArray gtoc;
+
+    if (gtocOffset > 0) {
+        reader.seek(gtocOffset);
+
+        if (reader.readView(4) != QByteArray("GTOC", 4)) {
+            reader.seek(start);
+            return false;
+        }
+
+        reader.seekRel(12);
+        gtoc = reader.readNextUTF();
+    }
+
+    reader.files = files;
+    reader.dataChunks = chunks;
+    reader._cpkOffset = index.get<qint64>(0x58);
+    reader._gtocOffset = gtocOffset;
+
+    if (gtocOffset > 0) {
+        reader._gtocUTF = new NaoCRIWareReader::UTFReader(gtoc);
+        reader._readGTOC();
+    }
+
+    reader._indexIds();
+    reader._indexPaths();
+
+    return true;
+}
+
+bool NaoIndexCache::load(NaoDATReader& reader) const {
+    Identity identity;
+    IndexReader index;
+
+    if (!identify(reader, identity) || !index.open(indexPath(identity.path), DAT, identity) || index.chunks != 0) {
+        return false;
+    }
+
+    QVector<NaoDATReader::EmbeddedFile> files(static_cast<int>(index.entries));
+
+    for (quint32 i = 0; i < index.entries; i++) {
+        NaoDATReader::EmbeddedFile& file = files[static_cast<int>(i)];
+        const quint64 record = index.entriesOffset + i * datEntrySize;
+
+        if (!index.string(record, file.name)) {
+            return false;
+        }
+
+        file.offset = index.get<quint32>(record + 0x08);
+        file.size = index.get<quint32>(record + 0x0C);
+    }
+
+    reader.files = files;
+    reader._indexPaths();
+
+    return true;
+}
+
+static bool writeIndex(const QString& directory, const QString& path, const QByteArray& data) {
+    if (!QDir().mkpath(directory)) {
+        return false;
+    }
+
+    // written next to it and renamed over it, so whoever reads it meanwhile sees the old one or the new one
+
+    QSaveFile file(path);
+
+    return file.open(QIODevice::WriteOnly) && file.write(data) == data.size() && file.commit();
+}
+
+bool NaoIndexCache::store(const NaoCRIWareReader& reader) const {
+    Identity identity;
+
+    if (!identify(reader, identity)) {
+        return false;
+    }
+
+    IndexWriter index(reader._isPak ? CPK : USM, identity);
+
+    index.patch<quint32>(0x30, static_cast<quint32>(reader.files.size()));
+    index.patch<quint32>(0x34, static_cast<quint32>(reader.dataChunks.size()));
+    index.patch<qint64>(0x58, reader._cpkOffset);
+    index.patch<qint64>(0x60, reader._gtocOffset);
+
+    index.patch<quint64>(0x38, static_cast<quint64>(index.pos()));
+
+    for (const NaoCRIWareReader::EmbeddedFile& file : reader.files) {
+        index.putString(file.origin);
+        index.putString(file.name);
+        index.putString(file.path);
+        index.putString(file.userString);
+        index.putString(file.localDir);
+        index.put<qint64>(file.offset);
+        index.put<qint64>(file.extraOffset);
+        index.put<qint64>(file.size);
+        index.put<qint64>(file.extractedSize);
+        index.put<quint32>(file.id);
+        index.put<quint32>(static_cast<quint32>(file.type));
+        index.put<qint64>(file.avbps);
+        index.put<qint64>(file.width);
+        index.put<qint64>(file.height);
+        index.put<qint64>(file.totalFrames);
+        index.put<qint64>(file.nFramerate);
+        index.put<qint64>(file.dFramerate);
+        index.put<qint64>(file.sampleRate);
+        index.put<qint64>(file.sampleCount);
+        index.put<qint64>(file.channelCount);
+        index.put<quint64>(file.updateDateTime);
+    }
+
+    index.patch<quint64>(0x40, static_cast<quint64>(index.pos()));
+
+    for (const NaoCRIWareReader::Chunk& chunk : reader.dataChunks) {
+        index.put<quint32>(static_cast<quint32>(chunk.type));
+        index.put<quint32>(static_cast<quint32>(chunk.dataType));
+        index.put<quint32>(chunk.size);
+        index.put<quint16>(chunk.headerSize);
+        index.put<quint16>(chunk.footerSize);
+        index.put<qint64>(chunk.offset);
+    }
+
+    return writeIndex(_directory, indexPath(identity.path), index.finish());
+}
+
+bool NaoIndexCache::store(const NaoDATReader& reader) const {
+    Identity identity;
+
+    if (!identify(reader, identity)) {
+        return false;
+    }
+
+    IndexWriter index(DAT, identity);
+
+    index.patch<quint32>(0x30, static_cast<quint32>(reader.files.size()));
+    index.patch<quint64>(0x38, static_cast<quint64>(index.pos()));
+
+    for (const NaoDATReader::EmbeddedFile& file : reader.files) {
+        index.putString(file.name);
+        index.put<quint32>(file.offset);
+        index.put<quint32>(file.size);
+    }
+
+    index.patch<quint64>(0x40, static_cast<quint64>(index.pos()));
+
+    return writeIndex(_directory, indexPath(identity.path), index.finish());
+}
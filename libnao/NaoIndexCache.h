@@ -0,0 +1,49 @@
+#ifndef NAOINDEXCACHE_H
+#define NAOINDEXCACHE_H
+
+#include "libnao_global.h"
+
+#include <QString>
+
+class NaoFileReader;
+class NaoCRIWareReader;
+class NaoDATReader;
+
+// Remembers what opening an archive found, so opening the same archive again doesn't have to parse anything.
+// Every archive gets its own index file in the cache directory, named after a hash of its absolute path. The index
+// has the archive's size, modification time and a hash of its first 0x800 bytes (all the headers), if any of those
+// changed it's ignored and the archive is parsed and indexed again.
+//
+// The format is little endian with fixed size records and a UTF-16 string pool, so it's read straight from a mapping:
+//
+//     header      0x80 bytes: "NAOINDEX", version, kind, archive size, mtime, header hash, counts and section offsets
+//     entries     fixed size records (CPK/USM entries or DAT entries), strings as pool offset and length
+//     chunks      USM chunk index, fixed size records
+//     pool        every distinct string once, UTF-16
+
+class LIBNAO_API NaoIndexCache {
+    public:
+    explicit NaoIndexCache(const QString& directory);
+
+    QString directory() const;
+
+    // where the index of the archive at path goes
+    QString indexPath(const QString& path) const;
+
+    // fill reader from its index, false if there's none or it doesn't match the archive (anymore)
+    bool load(NaoCRIWareReader& reader) const;
+    bool load(NaoDATReader& reader) const;
+
+    // (re)write the index of reader, false if it couldn't be written. readers opened from a device without
+    // a file name can't be cached
+    bool store(const NaoCRIWareReader& reader) const;
+    bool store(const NaoDATReader& reader) const;
+
+    // bumped whenever the layout changes, older indexes are just rebuilt
+    static constexpr quint32 version = 1;
+
+    private:
+    QString _directory;
+};
+
+#endif // NAOINDEXCACHE_H
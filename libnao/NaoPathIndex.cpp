@@ -0,0 +1,163 @@
+#include "NaoPathIndex.h"
+
+#include <algorithm>
+#include <functional>
+
+NaoPathIndex::NaoPathIndex(const QVector<QString>& paths) {
+
+    // the tree as it's found first, then laid out flat so everything in a directory is next to each other
+
+    struct Node {
+        QString name;
+        QString path;
+        int parent;
+        QVector<int> dirs;
+        QVector<QPair<QString, qint64>> entries;
+    };
+
+    QVector<Node> nodes;
+    QHash<QString, int> nodeByPath;
+
+    nodes.append({ QString(), QString(), -1, {}, {} });
+    nodeByPath.insert(QString(), 0);
+
+    // directories are made as they're needed, along with any parents that don't exist yet
+
+    std::function<int(const QString&)> dirFor = [&](const QString& path) -> int {
+        QHash<QString, int>::const_iterator it = nodeByPath.constFind(path);
+
+        if (it != nodeByPath.constEnd()) {
+            return it.value();
+        }
+
+        const int slash = path.lastIndexOf('/');
+        const int parent = dirFor((slash < 0) ? QString() : path.left(slash));
+        const int id = nodes.size();
+
+        nodes.append({ path.mid(slash + 1), path, parent, {}, {} });
+        nodes[parent].dirs.append(id);
+        nodeByPath.insert(path, id);
+
+        return id;
+    };
+
+    _entryByPath.reserve(paths.size());
+
+    for (int i = 0; i < paths.size(); i++) {
+        const QString path = normalise(paths.at(i));
+
+        if (!_entryByPath.contains(path)) {
+            _entryByPath.insert(path, i);
+        }
+
+        const int slash = path.lastIndexOf('/');
+        const int dir = dirFor((slash < 0) ? QString() : path.left(slash));
+
+        nodes[dir].entries.append(qMakePair(path.mid(slash + 1), static_cast<qint64>(i)));
+    }
+
+    // breadth first, so the subdirectories of each directory end up in one run
+
+    QVector<int> queue;
+    queue.append(0);
+
+    _dirs.reserve(nodes.size());
+    _dirs.append({ QString(), -1, 0, 0, 0, 0 });
+    _entries.reserve(paths.size());
+
+    for (int i = 0; i < queue.size(); i++) {
+        Node& node = nodes[queue.at(i)];
+
+        _dirByPath.insert(node.path, i);
+
+        std::sort(node.dirs.begin(), node.dirs.end(), [&](int a, int b) {
+            return nodes.at(a).name < nodes.at(b).name;
+        });
+
+        std::sort(node.entries.begin(), node.entries.end());
+
+        _dirs[i].firstDir = _dirs.size();
+        _dirs[i].dirCount = node.dirs.size();
+        _dirs[i].firstEntry = _entries.size();
+        _dirs[i].entryCount = node.entries.size();
+
+        for (int child : node.dirs) {
+            _dirs.append({ nodes.at(child).name, i, 0, 0, 0, 0 });
+            queue.append(child);
+        }
+
+        for (const QPair<QString, qint64>& entry : node.entries) {
+            _entries.append(entry.second);
+        }
+    }
+}
+
+QString NaoPathIndex::normalise(const QString& path) {
+
+    // most paths are fine as they are, don't copy those
+
+    bool clean = !path.startsWith('/') && !path.endsWith('/');
+
+    for (int i = 0; clean && i < path.size(); i++) {
+        if (path.at(i) == '\\' || (path.at(i) == '/' && i > 0 && path.at(i - 1) == '/')) {
+            clean = false;
+        }
+    }
+
+    if (clean) {
+        return path;
+    }
+
+    QString result;
+    result.reserve(path.size());
+
+    for (QChar c : path) {
+        if (c == '\\') {
+            c = '/';
+        }
+
+        // leading and repeated separators
+
+        if (c == '/' && (result.isEmpty() || result.endsWith('/'))) {
+            continue;
+        }
+
+        result += c;
+    }
+
+    if (result.endsWith('/')) {
+        result.chop(1);
+    }
+
+    return result;
+}
+
+qint64 NaoPathIndex::find(const QString& path) const {
+    return _entryByPath.value(normalise(path), -1);
+}
+
+int NaoPathIndex::findDir(const QString& path) const {
+    return _dirByPath.value(normalise(path), -1);
+}
+
+QString NaoPathIndex::dirPath(int dir) const {
+    QString path;
+
+    for (; dir > 0; dir = _dirs.at(dir).parent) {
+        path = path.isEmpty() ? _dirs.at(dir).name : (_dirs.at(dir).name + '/' + path);
+    }
+
+    return path;
+}
+
+const QVector<NaoPathIndex::Dir>& NaoPathIndex::dirs() const {
+    return _dirs;
+}
+
+const QVector<qint64>& NaoPathIndex::entries() const {
+    return _entries;
+}
+
+qint64 NaoPathIndex::size() const {
+    return _entries.size();
+}
@@ -0,0 +1,54 @@
+#ifndef NAOPATHINDEX_H
+#define NAOPATHINDEX_H
+
+#include "libnao_global.h"
+
+#include <QString>
+#include <QVector>
+#include <QHash>
+
+// Path lookups and directory listings over an archive's flat entry list.
+// Entry i is the one at paths[i] when it was built, directories are split on '/' (a '\' counts as one too).
+// find() is a single hash lookup. The directory tree is stored flat: every directory's subdirectories are
+// next to each other in dirs(), and its entries next to each other in entries() (entry indices sorted by path),
+// so listing one only touches what's in it.
+
+class LIBNAO_API NaoPathIndex {
+    public:
+    struct Dir {
+        QString name;       // last part of the path, empty for the root
+        int parent;         // -1 for the root
+        int firstDir;       // subdirectories are dirs() [firstDir, firstDir + dirCount)
+        int dirCount;
+        int firstEntry;     // entries are entries() [firstEntry, firstEntry + entryCount)
+        int entryCount;
+    };
+
+    NaoPathIndex() = default;
+    explicit NaoPathIndex(const QVector<QString>& paths);
+
+    // "a\\b//c/" is "a/b/c"
+    static QString normalise(const QString& path);
+
+    // entry at path, -1 if there's none. if paths repeat the first entry wins
+    qint64 find(const QString& path) const;
+
+    // the directory at path ("" is the root), -1 if there's none
+    int findDir(const QString& path) const;
+    QString dirPath(int dir) const;
+
+    // the root is dirs().first(), subdirectories and entries of each directory are sorted by name
+    const QVector<Dir>& dirs() const;
+    const QVector<qint64>& entries() const;
+
+    qint64 size() const;
+
+    private:
+    QHash<QString, qint64> _entryByPath;
+    QHash<QString, int> _dirByPath;
+
+    QVector<Dir> _dirs;
+    QVector<qint64> _entries;
+};
+
+#endif // NAOPATHINDEX_H
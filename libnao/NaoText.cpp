@@ -0,0 +1,175 @@
+#include "NaoText.h"
+#include "NaoShiftJISTable.h"
+
+// SSE2 is always there on x86-64 (and whenever the compiler is told it is), no runtime check needed
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define NAO_SIMD_SSE2
+
+#include <emmintrin.h>
+#endif
+
+static constexpr ushort replacement = 0xFFFD;
+
+int NaoText::widenAscii(const char* src, int size, ushort* dst) {
+    const uchar* in = reinterpret_cast<const uchar*>(src);
+    int i = 0;
+
+#ifdef NAO_SIMD_SSE2
+    const __m128i zero = _mm_setzero_si128();
+
+    for (; i + 16 <= size; i += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+
+        // the top bit of any byte is set, the scalar loop finds out which one
+
+        if (_mm_movemask_epi8(v) != 0) {
+            break;
+        }
+
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_unpacklo_epi8(v, zero));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i + 8), _mm_unpackhi_epi8(v, zero));
+    }
+#endif
+
+    for (; i < size && in[i] < 0x80; ++i) {
+        dst[i] = in[i];
+    }
+
+    return i;
+}
+
+QString NaoText::fromShiftJIS(const char* data, int size) {
+    const uchar* in = reinterpret_cast<const uchar*>(data);
+
+    // every byte or pair of bytes is one UTF-16 unit, so it never gets longer
+
+    QString result(size, Qt::Uninitialized);
+    ushort* out = reinterpret_cast<ushort*>(result.data());
+
+    int i = 0;
+    int o = 0;
+
+    while (i < size) {
+        int ascii = widenAscii(data + i, size - i, out + o);
+        i += ascii;
+        o += ascii;
+
+        if (i == size) {
+            break;
+        }
+
+        const uchar lead = in[i];
+
+        // half width katakana
+
+        if (lead >= 0xA1 && lead <= 0xDF) {
+            out[o++] = 0xFF61 + (lead - 0xA1);
+            i += 1;
+            continue;
+        }
+
+        int row = -1;
+
+        if (lead >= 0x81 && lead <= 0x9F) {
+            row = lead - 0x81;
+        } else if (lead >= 0xE0 && lead <= 0xFC) {
+            row = lead - 0xE0 + 31;
+        }
+
+        // not a lead byte, or one without a usable trail byte: only the lead byte is dropped
+
+        if (row < 0 || i + 1 == size || in[i + 1] < 0x40 || in[i + 1] > 0xFC) {
+            out[o++] = replacement;
+            i += 1;
+            continue;
+        }
+
+        ushort c = NaoShiftJIS::doubleByte[row][in[i + 1] - 0x40];
+        out[o++] = c ? c : replacement;
+        i += 2;
+    }
+
+    result.resize(o);
+
+    return result;
+}
+
+QString NaoText::fromUtf8(const char* data, int size) {
+    const uchar* in = reinterpret_cast<const uchar*>(data);
+
+    // no sequence has more UTF-16 units than it has bytes
+
+    QString result(size, Qt::Uninitialized);
+    ushort* out = reinterpret_cast<ushort*>(result.data());
+
+    int i = 0;
+    int o = 0;
+
+    while (i < size) {
+        int ascii = widenAscii(data + i, size - i, out + o);
+        i += ascii;
+        o += ascii;
+
+        if (i == size) {
+            break;
+        }
+
+        const uchar lead = in[i];
+
+        int length;
+        uint c;
+        uint min;
+
+        if (lead >= 0xC2 && lead <= 0xDF) {
+            length = 2;
+            c = lead & 0x1F;
+            min = 0x80;
+        } else if (lead >= 0xE0 && lead <= 0xEF) {
+            length = 3;
+            c = lead & 0x0F;
+            min = 0x800;
+        } else if (lead >= 0xF0 && lead <= 0xF4) {
+            length = 4;
+            c = lead & 0x07;
+            min = 0x10000;
+        } else {
+            return QString::fromUtf8(data, size);
+        }
+
+        if (i + length > size) {
+            return QString::fromUtf8(data, size);
+        }
+
+        for (int j = 1; j < length; ++j) {
+            if ((in[i + j] & 0xC0) != 0x80) {
+                return QString::fromUtf8(data, size);
+            }
+
+            c = (c << 6) | (in[i + j] & 0x3F);
+        }
+
+        // overlong, a surrogate or past the end of unicode
+
+        if (c < min || (c >= 0xD800 && c <= 0xDFFF) || c > 0x10FFFF) {
+            return QString::fromUtf8(data, size);
+        }
+
+        if (c >= 0x10000) {
+            out[o++] = static_cast<ushort>(0xD800 + ((c - 0x10000) >> 10));
+            out[o++] = static_cast<ushort>(0xDC00 + ((c - 0x10000) & 0x3FF));
+        } else {
+            out[o++] = static_cast<ushort>(c);
+        }
+
+        i += length;
+    }
+
+    result.resize(o);
+
+    return result;
+}
+
+QString NaoText::decode(Encoding encoding, const char* data, int size) {
+    return (encoding == ShiftJIS) ? fromShiftJIS(data, size) : fromUtf8(data, size);
+}
@@ -0,0 +1,41 @@
+#ifndef NAOTEXT_H
+#define NAOTEXT_H
+
+#include "libnao_global.h"
+
+#include <QString>
+#include <QByteArray>
+
+// Decoders for the two encodings CRIWare strings come in, without going through QTextCodec.
+// Almost every name in an archive is plain ASCII, so runs of it are widened 16 bytes at a time
+// and only what's left goes through the actual decoder.
+
+namespace NaoText {
+
+    enum Encoding {
+        ShiftJIS,   // code page 932, what @UTF tables with encoding 0 use
+        UTF8
+    };
+
+    // bytes that don't decode (a lone lead byte, a pair that isn't mapped) become U+FFFD.
+    // this is code page 932, which isn't quite what QTextCodec's "Shift-JIS" (used before) gives: 0x8160 is U+FF5E
+    // instead of U+301C, and likewise 0x815F, 0x8161, 0x817C, 0x8191, 0x8192 and 0x81CA get their fullwidth or
+    // Microsoft forms. NEC row 13 (0x87xx), the IBM extensions (0xED - 0xEE, 0xFA - 0xFC) and the user defined area
+    // (0xF0 - 0xF9, to the PUA) decode here and may not there, and 0x5C and 0x7E stay ASCII. that's all,
+    // the bench checks every single byte and pair against QTextCodec
+    LIBNAO_API QString fromShiftJIS(const char* data, int size);
+
+    // invalid sequences are left to QString::fromUtf8, so they come out the way Qt has them
+    LIBNAO_API QString fromUtf8(const char* data, int size);
+
+    LIBNAO_API QString decode(Encoding encoding, const char* data, int size);
+
+    inline QString decode(Encoding encoding, const QByteArray& data) {
+        return decode(encoding, data.constData(), data.size());
+    }
+
+    // widen the ASCII bytes at the start of src into dst (room for size), returns how many there were
+    LIBNAO_API int widenAscii(const char* src, int size, ushort* dst);
+}
+
+#endif // NAOTEXT_H
@@ -0,0 +1,229 @@
+#ifndef NAOUTFSCHEMA_H
+#define NAOUTFSCHEMA_H
+
+#include "NaoCRIWareReader.h"
+#include "NaoEndian.h"
+
+#include <array>
+#include <cstring>
+#include <tuple>
+#include <utility>
+#include <type_traits>
+
+// Decoders for @UTF tables with a known layout, like the CPK TOC and ETOC. A schema lists the columns that go into
+// a plain struct: the name, the type the column should have and the member it's stored in.
+//
+//     struct Entry { QString name; qint64 size; };
+//
+//     static constexpr auto entrySchema = NaoUTF::schema<Entry>(
+//         NaoUTF::field<NaoUTF::UTF::String>("FileName", &Entry::name),
+//         NaoUTF::field<NaoUTF::UTF::uInt>("FileSize", &Entry::size));
+//
+//     QVector<Entry> entries = entrySchema.decode(utf);
+//
+// decode() checks the table's columns against the schema once. If they all match every row is read with fixed
+// width loads at fixed offsets, without looking at a column type again. Otherwise (a column is missing, constant
+// or of another type) it goes through the typed accessors of UTFReader, so the result is the same either way.
+
+namespace NaoUTF {
+    typedef NaoCRIWareReader::UTFReader UTF;
+
+    // how a value of each type is stored in a row
+    template <quint32 Type> struct Cell;
+
+    template <> struct Cell<UTF::uChar> { typedef quint8 Raw; };
+    template <> struct Cell<UTF::sChar> { typedef qint8 Raw; };
+    template <> struct Cell<UTF::uShort> { typedef quint16 Raw; };
+    template <> struct Cell<UTF::sShort> { typedef qint16 Raw; };
+    template <> struct Cell<UTF::uInt> { typedef quint32 Raw; };
+    template <> struct Cell<UTF::sInt> { typedef qint32 Raw; };
+    template <> struct Cell<UTF::uLong> { typedef quint64 Raw; };
+    template <> struct Cell<UTF::sLong> { typedef qint64 Raw; };
+    template <> struct Cell<UTF::sFloat> { typedef quint32 Raw; };  // the bits
+    template <> struct Cell<UTF::sDouble> { typedef quint64 Raw; };
+    template <> struct Cell<UTF::String> { typedef quint32 Raw; };  // string table offset, or pool id once decoded
+    template <> struct Cell<UTF::Data> { typedef quint64 Raw; };    // offset << 32 | size
+
+    template <quint32 Type, typename Row, typename T>
+    struct Field {
+        static constexpr quint32 type = Type;
+        typedef Row RowType;
+        typedef T Value;
+
+        UTF::Key name;
+        T Row::* member;
+    };
+
+    // the column called name, holding Type values, goes to member
+    template <quint32 Type, typename Row, typename T>
+    constexpr Field<Type, Row, T> field(UTF::Key name, T Row::* member) {
+        return { name, member };
+    }
+
+    template <typename Row, typename... Fields>
+    class Schema {
+        static_assert(sizeof...(Fields) > 0, "a schema needs at least one field");
+        static_assert((std::is_same<typename Fields::RowType, Row>::value && ...), "every field has to belong to Row");
+
+        public:
+        constexpr Schema(Fields... fields) : _fields(fields...) { }
+
+        // whether utf's rows can be read by the specialised decoder
+        bool matches(const UTF& utf) const {
+            return _matches(utf, _resolve(utf));
+        }
+
+        // every row of utf, rows start out value initialised so columns that aren't there stay 0 or empty
+        QVector<Row> decode(const UTF& utf) const {
+            const Columns columns = _resolve(utf);
+
+            QVector<Row> rows(static_cast<int>(utf.rowCount));
+
+            if (!_matches(utf, columns)) {
+                _decodeGeneric(utf, columns, rows, Indices());
+            } else if (utf._decoding == UTF::Lazy) {
+                _decodeLazy(utf, columns, rows, Indices());
+            } else {
+                _decodeEager(utf, columns, rows, Indices());
+            }
+
+            return rows;
+        }
+
+        private:
+        typedef std::array<int, sizeof...(Fields)> Columns;
+        typedef std::index_sequence_for<Fields...> Indices;
+
+        template <std::size_t I>
+        using FieldAt = typename std::tuple_element<I, std::tuple<Fields...>>::type;
+
+        Columns _resolve(const UTF& utf) const {
+            return _resolve(utf, Indices());
+        }
+
+        template <std::size_t... I>
+        Columns _resolve(const UTF& utf, std::index_sequence<I...>) const {
+            return {{ utf.column(std::get<I>(_fields).name)... }};
+        }
+
+        template <std::size_t... I>
+        static bool _matches(const UTF& utf, const Columns& columns, std::index_sequence<I...>) {
+            return (_columnMatches<FieldAt<I>::type>(utf, columns[I]) && ...);
+        }
+
+        static bool _matches(const UTF& utf, const Columns& columns) {
+            return _matches(utf, columns, Indices());
+        }
+
+        // stored per row with exactly the type we expect
+        template <quint32 Type>
+        static bool _columnMatches(const UTF& utf, int column) {
+            if (column < 0) {
+                return false;
+            }
+
+            const quint8 flags = utf._columns.at(column).flags;
+
+            return (flags & UTF::RowVal) && !(flags & UTF::ConstVal) && (flags & 0x0F) == Type;
+        }
+
+        // a raw cell into the member it goes to. lazily decoded strings are offsets, eager ones pool ids
+        template <quint32 Type, typename T, typename Raw>
+        static void _store(const UTF& utf, T& dst, Raw v) {
+            if constexpr (Type == UTF::String) {
+                dst = (utf._decoding == UTF::Lazy) ? utf._lazyString(v) : utf._strings.at(static_cast<int>(v));
+            } else if constexpr (Type == UTF::Data) {
+                dst = utf._dataAt(v);
+            } else if constexpr (Type == UTF::sFloat) {
+                float f;
+                memcpy(&f, &v, 4);
+                dst = static_cast<T>(f);
+            } else if constexpr (Type == UTF::sDouble) {
+                double d;
+                memcpy(&d, &v, 8);
+                dst = static_cast<T>(d);
+            } else {
+                dst = static_cast<T>(v);
+            }
+        }
+
+        // straight from the packet, every field of a row at its offset in big endian
+        template <std::size_t... I>
+        void _decodeLazy(const UTF& utf, const Columns& columns, QVector<Row>& rows, std::index_sequence<I...>) const {
+            const std::array<int, sizeof...(Fields)> offsets = {{ utf._columns.at(columns[I]).rowOffset... }};
+
+            Row* out = rows.data();
+
+            for (quint32 row = 0; row < utf.rowCount; row++) {
+                const uchar* src = utf._rowData + static_cast<qint64>(row) * utf._rowSize;
+                Row& dst = out[row];
+
+                (_store<FieldAt<I>::type>(utf, dst.*(std::get<I>(_fields).member),
+                    NaoBytes::load<typename Cell<FieldAt<I>::type>::Raw, NaoEndian::Big>(src + offsets[I])), ...);
+            }
+        }
+
+        // from the decoded columns, already in host order
+        template <std::size_t... I>
+        void _decodeEager(const UTF& utf, const Columns& columns, QVector<Row>& rows, std::index_sequence<I...>) const {
+            const std::array<const char*, sizeof...(Fields)> values = {{ utf._columns.at(columns[I]).values.constData()... }};
+
+            Row* out = rows.data();
+
+            for (quint32 row = 0; row < utf.rowCount; row++) {
+                Row& dst = out[row];
+
+                (_store<FieldAt<I>::type>(utf, dst.*(std::get<I>(_fields).member),
+                    _hostLoad<typename Cell<FieldAt<I>::type>::Raw>(values[I], row)), ...);
+            }
+        }
+
+        template <typename Raw>
+        static Raw _hostLoad(const char* values, quint32 row) {
+            Raw v;
+            memcpy(&v, values + static_cast<qint64>(row) * sizeof(Raw), sizeof(Raw));
+
+            return v;
+        }
+
+        // the columns don't match, go through the accessors one column at a time
+        template <std::size_t... I>
+        void _decodeGeneric(const UTF& utf, const Columns& columns, QVector<Row>& rows, std::index_sequence<I...>) const {
+            (_decodeGenericColumn<FieldAt<I>::type>(utf, columns[I], std::get<I>(_fields).member, rows), ...);
+        }
+
+        template <quint32 Type, typename T>
+        static void _decodeGenericColumn(const UTF& utf, int column, T Row::* member, QVector<Row>& rows) {
+            if (!utf.hasValue(column)) {
+                return;
+            }
+
+            Row* out = rows.data();
+
+            for (quint32 row = 0; row < utf.rowCount; row++) {
+                T& dst = out[row].*member;
+
+                if constexpr (Type == UTF::String) {
+                    dst = utf.stringAt(column, row);
+                } else if constexpr (Type == UTF::Data) {
+                    dst = utf.dataAt(column, row);
+                } else if constexpr (Type == UTF::sFloat || Type == UTF::sDouble) {
+                    dst = static_cast<T>(utf.doubleAt(column, row));
+                } else if constexpr (std::is_signed<typename Cell<Type>::Raw>::value) {
+                    dst = static_cast<T>(utf.s64At(column, row));
+                } else {
+                    dst = static_cast<T>(utf.u64At(column, row));
+                }
+            }
+        }
+
+        std::tuple<Fields...> _fields;
+    };
+
+    template <typename Row, typename... Fields>
+    constexpr Schema<Row, Fields...> schema(Fields... fields) {
+        return Schema<Row, Fields...>(fields...);
+    }
+}
+
+#endif // NAOUTFSCHEMA_H
@@ -1,11 +1,15 @@
 #include "libnao.h"
 
+#ifdef _MSC_VER
 #pragma warning(push)
 #pragma warning(disable:4100)
+#endif
 
 #include "vdf_parser.hpp"
 
+#ifdef _MSC_VER
 #pragma warning(pop)
+#endif
 
 namespace LibNao {
     namespace Utils {
@@ -6,6 +6,8 @@
 
 QT       -= gui
 
+CONFIG += c++1z
+
 TARGET = libnao
 TEMPLATE = lib
 
@@ -26,7 +28,13 @@ SOURCES += \
         libnao.cpp \
     NaoCRIWareReader.cpp \
     NaoFileReader.cpp \
-    NaoDATReader.cpp
+    NaoDATReader.cpp \
+    NaoEndian.cpp \
+    NaoAsyncIO.cpp \
+    NaoCRILAYLA.cpp \
+    NaoText.cpp \
+    NaoPathIndex.cpp \
+    NaoIndexCache.cpp
 
 HEADERS += \
         libnao.h \
@@ -34,7 +42,16 @@ HEADERS += \
         vdf_parser.hpp \
     NaoCRIWareReader.h \
     NaoFileReader.h \
-    NaoDATReader.h
+    NaoDATReader.h \
+    NaoEndian.h \
+    NaoBinaryCursor.h \
+    NaoAsyncIO.h \
+    NaoCRILAYLA.h \
+    NaoText.h \
+    NaoShiftJISTable.h \
+    NaoUTFSchema.h \
+    NaoPathIndex.h \
+    NaoIndexCache.h
 
 unix {
     target.path = /usr/lib